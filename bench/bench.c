@@ -0,0 +1,501 @@
+#include "engine.h"
+
+#include <string.h>
+#include <time.h>
+
+// CPU microbenchmarks of engine code that does not need a GL context: the
+// engine_mathf.h kernels, noise, list growth, file loading and planet mesh
+// generation. Each case is first run for a warm-up period, which also picks
+// how many iterations make up one sample so that a sample lasts at least
+// --sample-ms. The samples are then timed one by one and summarized as
+// nanoseconds per operation. Results are written as JSON, progress goes to
+// stderr. Given the output of an earlier run with --baseline, each case also
+// reports its speedup over that run, which is how `make pgo` compares the
+// profile guided build against plain -O3.
+//
+// usage: bench [--filter text] [--warmup-ms ms] [--sample-ms ms]
+//              [--samples count] [--baseline file] [--output file]
+
+#define BENCH_DATA_COUNT (1024)
+#define BENCH_SAMPLES_MAX (1024)
+#define BENCH_NAME_MAX (64)
+#define BENCH_BASELINES_MAX (64)
+
+struct bench_case {
+  const char *group;
+  const char *name;
+  // operations done by one iteration, for the per operation times.
+  unsigned long operations;
+  // runs 'iterations' iterations. the result depends on all of the work, so
+  // it cannot be optimized away.
+  double (*run)(const unsigned long iterations);
+};
+
+struct bench_result {
+  unsigned long iterations;
+  unsigned int samples;
+  double min_ns, median_ns, mean_ns, max_ns;
+};
+
+static struct {
+  const char *filter;
+  double warmup_ms;
+  double sample_ms;
+  unsigned int samples;
+  const char *baseline_path;
+  const char *output_path;
+} bench_options = {
+    .warmup_ms = 200,
+    .sample_ms = 20,
+    .samples = 15,
+    .output_path = NULL,
+};
+
+// inputs shared by the math kernels, filled with the same values every run.
+static struct vec3 bench_vec3s[BENCH_DATA_COUNT];
+static struct quat bench_quats[BENCH_DATA_COUNT];
+static float bench_matrices[BENCH_DATA_COUNT][16];
+static struct transform bench_transforms[BENCH_DATA_COUNT];
+static float bench_x[BENCH_DATA_COUNT], bench_y[BENCH_DATA_COUNT],
+    bench_z[BENCH_DATA_COUNT], bench_radius[BENCH_DATA_COUNT];
+
+// median times of the --baseline run, by case name.
+static struct bench_baseline {
+  char name[BENCH_NAME_MAX];
+  double median_ns;
+} bench_baselines[BENCH_BASELINES_MAX];
+static unsigned int bench_baselines_count = 0;
+
+// results are written here, so no kernel is dead code.
+static volatile double bench_sink;
+
+static double bench_clock(void) {
+  struct timespec spec;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+#endif
+  return spec.tv_sec * 1e9 + spec.tv_nsec;
+}
+
+static float bench_random(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return (*state >> 8) * (1.0f / (1u << 24)) * 2 - 1;
+}
+
+static void bench_data_alloc(void) {
+  uint32_t random = 0x9e3779b9;
+  for (unsigned int i = 0; i < BENCH_DATA_COUNT; i++) {
+    bench_vec3s[i] = (struct vec3){bench_random(&random) * 100,
+                                   bench_random(&random) * 100,
+                                   bench_random(&random) * 100};
+    bench_quats[i] = quat_normalized(
+        (struct quat){bench_random(&random), bench_random(&random),
+                      bench_random(&random), bench_random(&random)});
+    for (int j = 0; j < 16; j++) {
+      bench_matrices[i][j] = bench_random(&random);
+    }
+    bench_transforms[i] = (struct transform){
+        .position = bench_vec3s[i],
+        .rotation = bench_quats[i],
+        .scale = vec3_one(1 + bench_random(&random) * 0.5f),
+    };
+    bench_x[i] = bench_vec3s[i].x;
+    bench_y[i] = bench_vec3s[i].y;
+    bench_z[i] = bench_vec3s[i].z;
+    bench_radius[i] = 1 + bench_random(&random) * 0.5f;
+  }
+}
+
+static double bench_vec3_normalized(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    sum += vec3_normalized(bench_vec3s[i % BENCH_DATA_COUNT]).x;
+  }
+  return sum;
+}
+
+static double bench_vec3_cross(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    sum += vec3_cross(bench_vec3s[i % BENCH_DATA_COUNT],
+                      bench_vec3s[(i + 1) % BENCH_DATA_COUNT])
+               .y;
+  }
+  return sum;
+}
+
+static double bench_vec3_rotate(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    sum += vec3_rotate(bench_vec3s[i % BENCH_DATA_COUNT],
+                       bench_quats[(i + 1) % BENCH_DATA_COUNT])
+               .z;
+  }
+  return sum;
+}
+
+static double bench_quat_multiply(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    sum += quat_multiply(bench_quats[i % BENCH_DATA_COUNT],
+                         bench_quats[(i + 1) % BENCH_DATA_COUNT])
+               .w;
+  }
+  return sum;
+}
+
+static double bench_quat_nlerp(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    sum += quat_nlerp(bench_quats[i % BENCH_DATA_COUNT],
+                      bench_quats[(i + 1) % BENCH_DATA_COUNT], 0.3f)
+               .w;
+  }
+  return sum;
+}
+
+static double bench_mat4_multiply(const unsigned long iterations) {
+  double sum = 0;
+  float result[16];
+  for (unsigned long i = 0; i < iterations; i++) {
+    mathf_mat4_multiply(result, bench_matrices[i % BENCH_DATA_COUNT],
+                        bench_matrices[(i + 1) % BENCH_DATA_COUNT]);
+    sum += result[i % 16];
+  }
+  return sum;
+}
+
+static double bench_transform_matrix(const unsigned long iterations) {
+  double sum = 0;
+  float result[16];
+  for (unsigned long i = 0; i < iterations; i++) {
+    mathf_transform_matrix(result, &bench_transforms[i % BENCH_DATA_COUNT]);
+    sum += result[i % 16];
+  }
+  return sum;
+}
+
+static double bench_frustum_cull_spheres(const unsigned long iterations) {
+  float projection[16];
+  mathf_mat4_identity(projection);
+  mathf_mat4_perspective(projection, 1.2f, 16.0f / 9.0f, 0.1f, 150.0f);
+  struct frustum frustum;
+  mathf_frustum_from_matrix(&frustum, projection, 0);
+
+  uint32_t visibility[BENCH_DATA_COUNT / 32];
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    mathf_frustum_cull_spheres(&frustum, bench_x, bench_y, bench_z,
+                               bench_radius, BENCH_DATA_COUNT, visibility);
+    sum += visibility[i % (BENCH_DATA_COUNT / 32)];
+  }
+  return sum;
+}
+
+static double bench_noise3(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    const struct vec3 p = bench_vec3s[i % BENCH_DATA_COUNT];
+    sum += mathf_noise3(p.x, p.y, p.z);
+  }
+  return sum;
+}
+
+static double bench_noise3_fbm(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    const struct vec3 p = bench_vec3s[i % BENCH_DATA_COUNT];
+    sum += mathf_noise3_fbm(p.x, p.y, p.z);
+  }
+  return sum;
+}
+
+static double bench_noise3_fbm_warped(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    const struct vec3 p = bench_vec3s[i % BENCH_DATA_COUNT];
+    sum += mathf_noise3_fbm_warped(p.x, p.y, p.z, 4);
+  }
+  return sum;
+}
+
+#define BENCH_LIST_LENGTH (1 << 16)
+
+static double bench_list_vec3_add(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    list_vec3 list = list_vec3_alloc();
+    for (unsigned int j = 0; j < BENCH_LIST_LENGTH; j++) {
+      list_vec3_add(&list, bench_vec3s[j % BENCH_DATA_COUNT]);
+    }
+    sum += list[i % BENCH_LIST_LENGTH].x;
+    list_vec3_free(list);
+  }
+  return sum;
+}
+
+static double bench_list_GLuint_add(const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    list_GLuint list = list_GLuint_alloc();
+    for (GLuint j = 0; j < BENCH_LIST_LENGTH; j++) {
+      list_GLuint_add(&list, j);
+    }
+    sum += list[i % BENCH_LIST_LENGTH];
+    list_GLuint_free(list);
+  }
+  return sum;
+}
+
+static double bench_file_load(const char *path,
+                              const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    const struct engine_file file = engine_file_load_as_string(path);
+    sum += file.error ? -1 : (double)file.length;
+    engine_file_free(file);
+  }
+  return sum;
+}
+
+static double bench_file_load_shader(const unsigned long iterations) {
+  return bench_file_load("res/shaders/planet_fragment.glsl", iterations);
+}
+
+static double bench_file_load_texture(const unsigned long iterations) {
+  return bench_file_load("res/textures/grass_1.jpeg", iterations);
+}
+
+// engine_mesh_planet_alloc without the upload, which is the only part that
+// needs GL.
+static double bench_planet_generate(const unsigned int subdivisions,
+                                    const unsigned long iterations) {
+  double sum = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    list_vec3 vertices = NULL, normals = NULL;
+    list_GLuint indices = NULL;
+    engine_mesh_planet_generate(subdivisions, vec3_one(1.0), vec3_zero(), 0.1,
+                                &vertices, &normals, &indices);
+    sum += list_vec3_count(vertices) + normals[0].x;
+    list_GLuint_free(indices);
+    list_vec3_free(vertices);
+    list_vec3_free(normals);
+  }
+  return sum;
+}
+
+static double bench_planet_generate_4(const unsigned long iterations) {
+  return bench_planet_generate(4, iterations);
+}
+
+static double bench_planet_generate_6(const unsigned long iterations) {
+  return bench_planet_generate(6, iterations);
+}
+
+static const struct bench_case bench_cases[] = {
+    {"mathf", "vec3_normalized", 1, bench_vec3_normalized},
+    {"mathf", "vec3_cross", 1, bench_vec3_cross},
+    {"mathf", "vec3_rotate", 1, bench_vec3_rotate},
+    {"mathf", "quat_multiply", 1, bench_quat_multiply},
+    {"mathf", "quat_nlerp", 1, bench_quat_nlerp},
+    {"mathf", "mat4_multiply", 1, bench_mat4_multiply},
+    {"mathf", "transform_matrix", 1, bench_transform_matrix},
+    {"mathf", "frustum_cull_spheres", BENCH_DATA_COUNT,
+     bench_frustum_cull_spheres},
+    {"noise", "noise3", 1, bench_noise3},
+    {"noise", "noise3_fbm", 1, bench_noise3_fbm},
+    {"noise", "noise3_fbm_warped", 1, bench_noise3_fbm_warped},
+    {"list", "vec3_add_65536", BENCH_LIST_LENGTH, bench_list_vec3_add},
+    {"list", "GLuint_add_65536", BENCH_LIST_LENGTH, bench_list_GLuint_add},
+    {"file", "load_shader", 1, bench_file_load_shader},
+    {"file", "load_texture", 1, bench_file_load_texture},
+    {"mesh", "planet_generate_4", 1, bench_planet_generate_4},
+    {"mesh", "planet_generate_6", 1, bench_planet_generate_6},
+};
+
+static int bench_compare(const void *a, const void *b) {
+  const double time_a = *(const double *)a;
+  const double time_b = *(const double *)b;
+  return (time_a > time_b) - (time_a < time_b);
+}
+
+static struct bench_result bench_case_run(const struct bench_case *bench) {
+  // grow the iterations of a sample until one takes sample_ms, then keep
+  // running until the warm-up period is over.
+  unsigned long iterations = 1;
+  const double warmup_begin = bench_clock();
+  for (;;) {
+    const double begin = bench_clock();
+    bench_sink = bench->run(iterations);
+    const double elapsed = bench_clock() - begin;
+    if (elapsed < bench_options.sample_ms * 1e6) {
+      iterations *= 2;
+    } else if (bench_clock() - warmup_begin >= bench_options.warmup_ms * 1e6) {
+      break;
+    }
+  }
+
+  double times[BENCH_SAMPLES_MAX];
+  struct bench_result result = {
+      .iterations = iterations,
+      .samples = bench_options.samples,
+  };
+  double total = 0;
+  for (unsigned int i = 0; i < result.samples; i++) {
+    const double begin = bench_clock();
+    bench_sink = bench->run(iterations);
+    times[i] =
+        (bench_clock() - begin) / ((double)iterations * bench->operations);
+    total += times[i];
+  }
+
+  qsort(times, result.samples, sizeof(*times), bench_compare);
+  result.min_ns = times[0];
+  result.median_ns = times[result.samples / 2];
+  result.mean_ns = total / result.samples;
+  result.max_ns = times[result.samples - 1];
+  return result;
+}
+
+// reads the cases of an earlier run. only this program's own output needs
+// to be understood, which has one case per line.
+static bool bench_baseline_load(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    engine_error("failed to open baseline '%s'", path);
+    return false;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), file) != NULL &&
+         bench_baselines_count < BENCH_BASELINES_MAX) {
+    struct bench_baseline *baseline = &bench_baselines[bench_baselines_count];
+    const char *median = strstr(line, "\"median_ns\":");
+    if (sscanf(line, "{\"name\":\"%63[^\"]\"", baseline->name) == 1 &&
+        median != NULL &&
+        sscanf(median, "\"median_ns\":%lf", &baseline->median_ns) == 1) {
+      bench_baselines_count++;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static const struct bench_baseline *bench_baseline_find(const char *name) {
+  for (unsigned int i = 0; i < bench_baselines_count; i++) {
+    if (strcmp(bench_baselines[i].name, name) == 0) {
+      return &bench_baselines[i];
+    }
+  }
+  return NULL;
+}
+
+static bool bench_arguments_parse(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    const bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--filter") == 0 && has_value) {
+      bench_options.filter = argv[++i];
+    } else if (strcmp(argv[i], "--warmup-ms") == 0 && has_value) {
+      bench_options.warmup_ms = strtod(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--sample-ms") == 0 && has_value) {
+      bench_options.sample_ms = strtod(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--samples") == 0 && has_value) {
+      bench_options.samples = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--baseline") == 0 && has_value) {
+      bench_options.baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+      bench_options.output_path = argv[++i];
+    } else {
+      engine_error("unknown argument '%s'", argv[i]);
+      return false;
+    }
+  }
+  if (bench_options.samples == 0 || bench_options.samples > BENCH_SAMPLES_MAX) {
+    engine_error("--samples must be between 1 and %d", BENCH_SAMPLES_MAX);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_arguments_parse(argc, argv)) {
+    return 1;
+  }
+  if (bench_options.baseline_path != NULL &&
+      !bench_baseline_load(bench_options.baseline_path)) {
+    return 1;
+  }
+
+  FILE *output = stdout;
+  if (bench_options.output_path != NULL) {
+    output = fopen(bench_options.output_path, "w");
+    if (output == NULL) {
+      engine_error("failed to open '%s'", bench_options.output_path);
+      return 1;
+    }
+  }
+
+  bench_data_alloc();
+
+  fprintf(output,
+          "{\"warmup_ms\":%.1f,\"sample_ms\":%.1f,\"samples\":%u,"
+          "\"benchmarks\":[",
+          bench_options.warmup_ms, bench_options.sample_ms,
+          bench_options.samples);
+  bool is_first = true;
+  // speedups are summarized by their geometric mean, so a case that got
+  // twice as slow cancels one that got twice as fast.
+  double log_speedup_total = 0;
+  unsigned int speedups_count = 0;
+  for (size_t i = 0; i < sizeof(bench_cases) / sizeof(*bench_cases); i++) {
+    const struct bench_case *bench = &bench_cases[i];
+    char full_name[BENCH_NAME_MAX];
+    snprintf(full_name, sizeof(full_name), "%s/%s", bench->group, bench->name);
+    if (bench_options.filter != NULL &&
+        strstr(full_name, bench_options.filter) == NULL) {
+      continue;
+    }
+
+    const struct bench_result result = bench_case_run(bench);
+    fprintf(stderr, "%-32s %12.2f ns/op (min %.2f, max %.2f)", full_name,
+            result.median_ns, result.min_ns, result.max_ns);
+    fprintf(output,
+            "%s\n{\"name\":\"%s\",\"operations\":%lu,\"iterations\":%lu,"
+            "\"min_ns\":%.3f,\"median_ns\":%.3f,\"mean_ns\":%.3f,"
+            "\"max_ns\":%.3f",
+            is_first ? "" : ",", full_name, bench->operations,
+            result.iterations, result.min_ns, result.median_ns,
+            result.mean_ns, result.max_ns);
+    is_first = false;
+
+    const struct bench_baseline *baseline = bench_baseline_find(full_name);
+    if (baseline != NULL && result.median_ns > 0) {
+      const double speedup = baseline->median_ns / result.median_ns;
+      log_speedup_total += log(speedup);
+      speedups_count++;
+      fprintf(stderr, " %.3fx baseline", speedup);
+      fprintf(output, ",\"baseline_median_ns\":%.3f,\"speedup\":%.4f",
+              baseline->median_ns, speedup);
+    }
+    fputc('\n', stderr);
+    fputc('}', output);
+  }
+  fprintf(output, "\n]");
+
+  if (speedups_count > 0) {
+    const double speedup = exp(log_speedup_total / speedups_count);
+    fprintf(stderr, "%.3fx the baseline over %u cases (geometric mean)\n",
+            speedup, speedups_count);
+    fprintf(output, ",\"speedup\":%.4f", speedup);
+  }
+  fprintf(output, "}\n");
+
+  if (output != stdout && fclose(output) != 0) {
+    engine_error("failed to write '%s'", bench_options.output_path);
+    return 1;
+  }
+  return 0;
+}
@@ -1,9 +1,7 @@
 #version 330 core
 layout (location = 0) in vec3 in_position;
-
-uniform mat4 u_transform_matrix;
-uniform mat4 u_camera_matrix;
+layout (location = 4) in mat4 in_transform_matrix; // per instance
 
 void main() {
-  gl_Position = u_camera_matrix * u_transform_matrix * vec4(in_position, 1.0);
+  gl_Position = u_camera_matrix * in_transform_matrix * vec4(in_position, 1.0);
 }
@@ -7,8 +7,6 @@ in VS_OUT {
 
 out vec4 FragColor;
 
-uniform vec3 u_camera_position;
-
 void main() {
   FragColor = vec4(fs_in.normal, 0.3);
 }
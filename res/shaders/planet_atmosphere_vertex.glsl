@@ -1,17 +1,21 @@
 #version 330 core
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 4) in mat4 in_transform_matrix; // per instance
+layout (location = 8) in mat3 in_normal_matrix;    // per instance
 
 out VS_OUT {
   vec3 position;
   vec3 normal;
 } vs_out;
 
-uniform mat4 u_transform_matrix;
-uniform mat4 u_camera_matrix;
-
 void main() {
   vs_out.position = in_position;
-  vs_out.normal = normalize(mat3(u_camera_matrix * u_transform_matrix) * in_normal);
-  gl_Position = u_camera_matrix * u_transform_matrix * vec4(in_position, 1.0);
+  vs_out.normal = normalize(mat3(u_camera_matrix) * (in_normal_matrix * in_normal));
+  gl_Position = u_camera_matrix * in_transform_matrix * vec4(in_position, 1.0);
+
+  if (u_log_depth > 0.0) {
+    gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * u_log_depth - 1.0) *
+                    gl_Position.w;
+  }
 }
@@ -1,5 +1,10 @@
 #version 330 core
 
+// texturing mode, chosen by defining one of these after the #version line:
+//   PLANET_TEXTURING_TRIPLANAR  the three planar projections are blended
+//   PLANET_TEXTURING_CUBEMAP    one fetch from a cube map
+// without either, there is one planar fetch along the strongest axis.
+
 in VS_OUT {
   vec3 position;
   vec3 normal;
@@ -8,29 +13,69 @@ in VS_OUT {
 
 out vec4 FragColor;
 
+#ifdef PLANET_TEXTURING_CUBEMAP
+uniform samplerCube u_diffuse_map;
+#else
 uniform sampler2D u_diffuse_map;
-uniform vec3 u_light_position;
-uniform vec3 u_camera_position;
+#endif
 
+// triplanar projections weighted below this are not fetched at all.
+const float blend_threshold = 0.05;
 
-void main() {
-  // object color
-  vec3 colorX = texture(u_diffuse_map, fs_in.position.zy).rgb;
-  vec3 colorY = texture(u_diffuse_map, fs_in.position.xz).rgb;
-  vec3 colorZ = texture(u_diffuse_map, fs_in.position.xy).rgb;
+vec3 planet_color() {
+#if defined(PLANET_TEXTURING_CUBEMAP)
+  // the sphere is centered on the origin, so its local position doubles as
+  // the lookup direction.
+  return texture(u_diffuse_map, fs_in.position).rgb;
+#else
+  // fetches happen in branches, so take derivatives up front where they are
+  // still defined.
+  vec3 dx = dFdx(fs_in.position);
+  vec3 dy = dFdy(fs_in.position);
+  vec3 n = abs(normalize(fs_in.normal_local));
 
-  float blend_sharpness = 4;
+#if defined(PLANET_TEXTURING_TRIPLANAR)
+  // blend sharpness of 4, written as two squares instead of pow.
+  vec3 blend_weight = n * n;
+  blend_weight *= blend_weight;
+  blend_weight /= dot(blend_weight, vec3(1));
 
-  vec3 blend_weight = pow(abs(normalize(fs_in.normal_local)), vec3(blend_sharpness));
+  // drop near-zero projections and renormalize so the blend stays continuous.
+  blend_weight = max(blend_weight - blend_threshold, 0.0);
   blend_weight /= dot(blend_weight, vec3(1));
 
-  // vec3 color = fs_in.normal_local * 0.5;
-  vec3 color = colorX * blend_weight.x + colorY * blend_weight.y +
-    colorZ * blend_weight.z;
+  vec3 color = vec3(0);
+  if (blend_weight.x > 0.0) {
+    color += blend_weight.x *
+             textureGrad(u_diffuse_map, fs_in.position.zy, dx.zy, dy.zy).rgb;
+  }
+  if (blend_weight.y > 0.0) {
+    color += blend_weight.y *
+             textureGrad(u_diffuse_map, fs_in.position.xz, dx.xz, dy.xz).rgb;
+  }
+  if (blend_weight.z > 0.0) {
+    color += blend_weight.z *
+             textureGrad(u_diffuse_map, fs_in.position.xy, dx.xy, dy.xy).rgb;
+  }
+  return color;
+#else
+  if (n.x >= n.y && n.x >= n.z) {
+    return textureGrad(u_diffuse_map, fs_in.position.zy, dx.zy, dy.zy).rgb;
+  } else if (n.y >= n.z) {
+    return textureGrad(u_diffuse_map, fs_in.position.xz, dx.xz, dy.xz).rgb;
+  }
+  return textureGrad(u_diffuse_map, fs_in.position.xy, dx.xy, dy.xy).rgb;
+#endif
+#endif
+}
+
+void main() {
+  // object color
+  vec3 color = planet_color();
 
   vec3 ambient = 0.1 * color;
   // diffuse
-  vec3 lightDir = normalize(u_light_position - fs_in.position);
+  vec3 lightDir = normalize(u_light_position.xyz - fs_in.position);
   vec3 normal = normalize(fs_in.normal);
   float diff = max(dot(lightDir, normal), 0.0);
   vec3 diffuse = diff * color;
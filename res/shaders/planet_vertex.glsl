@@ -1,6 +1,8 @@
 #version 330 core
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 4) in mat4 in_transform_matrix; // per instance
+layout (location = 8) in mat3 in_normal_matrix;    // per instance
 
 out VS_OUT {
   vec3 position;
@@ -8,12 +10,14 @@ out VS_OUT {
   vec3 normal_local;
 } vs_out;
 
-uniform mat4 u_transform_matrix;
-uniform mat4 u_camera_matrix;
-
 void main() {
   vs_out.position = in_position;
-  vs_out.normal = mat3(transpose(inverse(u_transform_matrix))) * in_normal;
+  vs_out.normal = in_normal_matrix * in_normal;
   vs_out.normal_local = in_normal;
-  gl_Position = u_camera_matrix * u_transform_matrix * vec4(in_position, 1.0);
+  gl_Position = u_camera_matrix * in_transform_matrix * vec4(in_position, 1.0);
+
+  if (u_log_depth > 0.0) {
+    gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * u_log_depth - 1.0) *
+                    gl_Position.w;
+  }
 }
@@ -12,6 +12,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+typedef struct vec2 vec2;
+typedef struct vec3 vec3;
+
+DECLARE_LIST(vec2)
+DECLARE_LIST(vec3)
+DECLARE_LIST(GLuint)
+DECLARE_LIST(GLint)
+
 bool engine_start(void);
 void engine_stop(void);
 void engine_update(void);
@@ -20,8 +28,19 @@ bool engine_is_running(void);
 
 #ifdef __linux__
 #define ENGINE_GLX
+#define ENGINE_HEADLESS
 #endif // __linux__
 
+#ifdef ENGINE_HEADLESS
+void engine_headless_set(const unsigned long frames_count);
+bool engine_is_headless(void);
+bool engine_headless_start(void);
+void engine_headless_stop(void);
+void engine_headless_update(void);
+bool engine_headless_is_running(void);
+float engine_headless_aspect_ratio(void);
+#endif // ENGINE_HEADLESS
+
 #ifdef ENGINE_GLX
 
 #include "glad/glx.h"
@@ -60,32 +79,444 @@ struct mesh {
   GLuint EBO;
   GLuint vertices_count;
   GLuint indices_count;
+  // where the mesh starts inside shared buffers. zero for meshes that own
+  // their buffers.
+  GLuint first_index;
+  GLint base_vertex;
   bool use_indexed_draw;
   bool use_clockwise_winding;
+  // the buffers belong to the mesh pool and are not freed with the mesh.
+  bool is_pooled;
 };
 
+extern const vec3 engine_mesh_cube_vertices[36];
+extern const vec3 engine_mesh_cube_normals[36];
+extern const vec3 engine_mesh_quad_vertices[6];
+extern const vec3 engine_mesh_quad_normals[6];
+
 struct mesh engine_mesh_quad_alloc(void);
 struct mesh engine_mesh_cube_alloc(void);
 
+void engine_mesh_planet_generate(const unsigned int subdivisions,
+                                 const struct vec3 noise_scale,
+                                 const struct vec3 noise_offset,
+                                 const float amplitude, list_vec3 *vertices,
+                                 list_vec3 *normals, list_GLuint *indices);
 struct mesh engine_mesh_planet_alloc(const unsigned int subdivisions,
                                      const struct vec3 noise_scale,
                                      const struct vec3 noise_offset,
                                      const float amplitude);
+struct mesh engine_mesh_upload(const struct vec3 *vertices,
+                               const struct vec3 *normals,
+                               const GLuint vertices_count,
+                               const GLuint *indices,
+                               const GLuint indices_count);
+void engine_mesh_free(struct mesh *mesh);
+
+// one vertex array, vertex buffer and index buffer shared by static meshes,
+// so they can be drawn together with glMultiDrawElementsIndirect.
+// allocations are never returned to the pool.
+void engine_mesh_pool_alloc(const GLuint vertices_capacity,
+                            const GLuint indices_capacity);
+void engine_mesh_pool_free(void);
+struct mesh engine_mesh_pool_add(const struct vec3 *vertices,
+                                 const struct vec3 *normals,
+                                 const GLuint vertices_count,
+                                 const GLuint *indices,
+                                 const GLuint indices_count);
+
+struct transform_array transform_array_alloc(const unsigned int capacity);
+void transform_array_free(struct transform_array *transforms);
+unsigned int transform_array_add(struct transform_array *transforms,
+                                 const struct transform transform);
+void transform_array_set(struct transform_array *transforms,
+                         const unsigned int index,
+                         const struct transform transform);
+struct transform transform_array_get(const struct transform_array *transforms,
+                                     const unsigned int index);
+void engine_transform_array_upload(GLuint buffer,
+                                   const struct transform_array *transforms);
+
+enum camera_depth_mode {
+  CAMERA_DEPTH_STANDARD,
+  // reversed-Z with an infinite far plane. needs glClipControl and a floating
+  // point depth buffer, otherwise the camera falls back to logarithmic depth.
+  CAMERA_DEPTH_REVERSED_Z,
+  // logarithmic depth written by the vertex shader through u_log_depth.
+  CAMERA_DEPTH_LOGARITHMIC,
+};
 
+// the camera renders relative to 'origin', a double precision world position.
+// 'transform.position' is the camera's offset from that origin, so the
+// camera's world position is origin + transform.position.
 struct camera {
   struct transform transform;
+  struct vec3d origin;
   float *matrix;
+  float fov, near, far;
+  enum camera_depth_mode depth_mode;
+  float log_depth_coefficient;
 };
 
 struct camera camera_alloc(void);
 void camera_update(struct camera *camera);
+void camera_recenter(struct camera *camera);
+bool camera_depth_mode_is_supported(enum camera_depth_mode mode);
+void camera_depth_mode_set(struct camera *camera, enum camera_depth_mode mode);
+struct vec3d camera_world_position(const struct camera *camera);
+struct frustum camera_frustum(const struct camera *camera);
+
+// a pose on a camera path, 'time' seconds after the path starts. see
+// engine_camera_path.c
+struct camera_path_key {
+  double time;
+  struct vec3d position;
+  struct quat rotation;
+};
+typedef struct camera_path_key camera_path_key;
+DECLARE_LIST(camera_path_key)
+
+double camera_path_duration(const list_camera_path_key keys);
+void camera_path_sample(const list_camera_path_key keys, const double time,
+                        struct vec3d *position, struct quat *rotation);
+list_camera_path_key camera_path_load(const char *path);
+bool camera_path_save(const list_camera_path_key keys, const char *path);
+
+// floating origin rebasing for float-only scenes. see engine_origin.c
+#define ENGINE_ORIGIN_DEFAULT_THRESHOLD (1024.0 /* units */)
+
+// called during a rebase so cached matrices and spatial structures can
+// subtract 'shift' from anything they store in world space.
+typedef void (*engine_origin_rebase_fn)(const struct vec3 shift,
+                                        void *user_data);
+
+struct engine_origin_stats {
+  unsigned int rebase_count, deferred_count;
+  double last_cost, max_cost, total_cost;
+};
+
+void engine_origin_register(struct transform *transform);
+void engine_origin_unregister(struct transform *transform);
+void engine_origin_register_array(struct transform_array *transforms);
+void engine_origin_unregister_array(struct transform_array *transforms);
+void engine_origin_register_callback(engine_origin_rebase_fn callback,
+                                     void *user_data);
+void engine_origin_set_threshold(const float threshold);
+bool engine_origin_update(struct camera *camera, const double frame_slack);
+struct vec3d engine_origin_offset(void);
+struct engine_origin_stats engine_origin_stats_get(void);
+
+// handle of an interned uniform or attribute name, see
+// engine_shader_name_intern.
+typedef unsigned int engine_name;
+
+// uniforms set by the engine on every draw. these are interned before any
+// other name, so each value is also the name's interned handle.
+enum engine_uniform {
+  ENGINE_UNIFORM_DIFFUSE_MAP,
+  ENGINE_UNIFORM_COUNT,
+};
+
+// attribute locations of the per-instance model matrix and its normal
+// matrix. matrices take one location per column, so locations 4 to 7 and
+// 8 to 10 are reserved for them.
+#define ENGINE_ATTRIBUTE_TRANSFORM_MATRIX (4)
+#define ENGINE_ATTRIBUTE_NORMAL_MATRIX (8)
+
+// uniform buffer binding points shared by all programs.
+enum engine_uniform_block {
+  ENGINE_UNIFORM_BLOCK_FRAME,
+};
+
+#define ENGINE_FRAME_RING_SIZE (3 /* frames */)
+
+// a buffer for data rewritten every frame. it holds one region per frame in
+// flight; with ARB_buffer_storage it is persistently mapped and a fence per
+// frame keeps the CPU from overwriting a region the GPU is still reading.
+// without it, regions are mapped unsynchronized and the whole buffer is
+// orphaned each time the ring wraps.
+struct engine_stream_buffer {
+  GLuint buffer;
+  GLuint retired_buffer;
+  GLenum target;
+  GLsizeiptr region_size;
+  GLintptr offset;
+  unsigned long frame;
+  unsigned int region;
+  void *mapped;
+  bool is_persistent;
+};
+
+void engine_stream_frame_begin(void);
+void engine_stream_frame_end(void);
+struct engine_stream_buffer engine_stream_buffer_alloc(
+    const GLenum target, const GLsizeiptr region_size);
+void engine_stream_buffer_free(struct engine_stream_buffer *stream);
+void *engine_stream_buffer_map(struct engine_stream_buffer *stream,
+                               const GLsizeiptr size,
+                               const GLsizeiptr alignment, GLintptr *offset);
+void engine_stream_buffer_unmap(struct engine_stream_buffer *stream);
+
+// CPU copy of the std140 'engine_frame' uniform block. positions are
+// relative to the camera origin and stored as vec4 to match std140 layout.
+struct engine_frame_constants {
+  GLfloat camera_matrix[16];
+  GLfloat camera_position[4];
+  GLfloat light_position[4];
+  GLfloat log_depth;
+  GLfloat padding[3];
+};
+
+// the block as shaders see it. engine_shader inserts it after the #version
+// line of every shader, so it is declared in this one place and must match
+// struct engine_frame_constants member for member. u_log_depth is
+// 2 / log2(far + 1), 0 disables logarithmic depth.
+#define ENGINE_FRAME_CONSTANTS_GLSL                                            \
+  "layout (std140) uniform engine_frame {\n"                                   \
+  "  mat4 u_camera_matrix;\n"                                                  \
+  "  vec4 u_camera_position;\n"                                                \
+  "  vec4 u_light_position;\n"                                                 \
+  "  float u_log_depth;\n"                                                     \
+  "};\n"
+
+void engine_frame_constants_alloc(void);
+void engine_frame_constants_free(void);
+void engine_frame_constants_update(
+    const struct engine_frame_constants *constants);
+
+enum engine_shader_status {
+  ENGINE_SHADER_PENDING,
+  ENGINE_SHADER_READY,
+  ENGINE_SHADER_FAILED,
+};
+
+// a linked shader program together with the locations of all of its active
+// uniforms and attributes, indexed by interned name. inactive names map to -1.
+// programs from engine_shader_load may still be compiling; the locations are
+// only filled in once the program is ready.
+struct shader {
+  GLuint program;
+  list_GLint uniform_locations;
+  list_GLint attribute_locations;
+  enum engine_shader_status status;
+  // compiled stages that still have to be checked, while pending.
+  GLuint vertex_shader;
+  GLuint fragment_shader;
+  uint64_t cache_key;
+  char *vertex_shader_file_path;
+  char *fragment_shader_file_path;
+  char *defines;
+  // drawn instead of this program until it is ready. may be NULL.
+  struct shader *fallback;
+  // rebuild started by engine_shader_reload, swapped in once it is ready.
+  struct shader *reload;
+};
 
 GLuint engine_shader_compile_source(const char *file_path,
                                     uint32_t shader_type);
-GLuint engine_shader_create(const char *vertex_shader_file_path,
-                            const char *fragment_shader_file_path);
+GLuint engine_shader_compile_source_with_defines(const char *file_path,
+                                                 uint32_t shader_type,
+                                                 const char *defines);
+struct shader *engine_shader_create(const char *vertex_shader_file_path,
+                                    const char *fragment_shader_file_path);
+struct shader *
+engine_shader_create_with_defines(const char *vertex_shader_file_path,
+                                  const char *fragment_shader_file_path,
+                                  const char *defines);
+struct shader *engine_shader_load(const char *vertex_shader_file_path,
+                                  const char *fragment_shader_file_path,
+                                  const char *defines);
+bool engine_shader_is_ready(struct shader *shader);
+bool engine_shader_wait(struct shader *shader);
+struct shader *engine_shader_resolve(struct shader *shader);
+void engine_shader_reload(struct shader *shader);
+void engine_shader_reload_update(struct shader *shader);
+void engine_shader_free(struct shader *shader);
+engine_name engine_shader_name_intern(const char *name);
+
+#define ENGINE_HASH_SEED (0xcbf29ce484222325ull)
+uint64_t engine_hash(const void *data, const size_t size, uint64_t hash);
+
+// linked program binaries are cached here, relative to the working directory.
+#define ENGINE_SHADER_CACHE_DIRECTORY "cache/shaders"
+uint64_t engine_shader_cache_key(const char *vertex_source,
+                                 const char *fragment_source,
+                                 const char *defines);
+GLuint engine_shader_cache_load(const uint64_t key);
+void engine_shader_cache_store(const uint64_t key, const GLuint program);
+
+bool engine_shader_watch_start(void);
+void engine_shader_watch_stop(void);
+void engine_shader_watch_add(struct shader *shader);
+void engine_shader_watch_remove(struct shader *shader);
+void engine_shader_watch_update(void);
+
+// a preprocessor feature of a shader_variants family. features are switched
+// on by defining 'define' after the #version line. a feature with a
+// 'max_depth' above 0 is dropped for draws farther than that from the
+// camera, so distant objects get a cheaper variant. a feature that changes
+// the shader's interface, such as a sampler type, 'is_required': a variant
+// without it cannot stand in for one with it, and it is never dropped.
+struct shader_feature {
+  const char *define;
+  float max_depth;
+  bool is_required;
+};
+
+#define ENGINE_SHADER_FEATURES_MAX (8)
+
+// every permutation of a set of features for one pair of shader files.
+// variants are indexed by their feature mask, bit i meaning features[i], and
+// are only compiled once a draw asks for them.
+struct shader_variants {
+  char *vertex_shader_file_path;
+  char *fragment_shader_file_path;
+  struct shader_feature features[ENGINE_SHADER_FEATURES_MAX];
+  unsigned int features_count;
+  struct shader *variants[1 << ENGINE_SHADER_FEATURES_MAX];
+  // drawn when no variant that fits a draw is ready. may be NULL.
+  struct shader *fallback;
+};
+
+struct shader_variants *
+engine_shader_variants_alloc(const char *vertex_shader_file_path,
+                             const char *fragment_shader_file_path,
+                             const struct shader_feature *features,
+                             const unsigned int features_count);
+void engine_shader_variants_free(struct shader_variants *variants);
+struct shader *engine_shader_variant_request(struct shader_variants *variants,
+                                             const unsigned int features);
+struct shader *engine_shader_variant_select(struct shader_variants *variants,
+                                            unsigned int features,
+                                            const float depth);
+GLint engine_shader_uniform_location(const struct shader *shader,
+                                     const engine_name name);
+GLint engine_shader_attribute_location(const struct shader *shader,
+                                       const engine_name name);
+
+enum engine_render_pass {
+  ENGINE_RENDER_PASS_OPAQUE,
+  ENGINE_RENDER_PASS_TRANSPARENT,
+};
+
+// GL state changes made by the render queue during the last flush.
+struct engine_render_stats {
+  unsigned int draw_calls;
+  unsigned int instances;
+  unsigned long triangles;
+  unsigned int indirect_commands;
+  unsigned int program_changes;
+  unsigned int texture_changes;
+  unsigned int vertex_array_changes;
+  unsigned int front_face_changes;
+};
+
+void engine_render_queue_begin(void);
+void engine_render_queue_scope(const char *name);
+void engine_render_queue_scopes_enable(const bool is_enabled);
+void engine_render_queue_submit(const struct mesh *mesh,
+                                const GLfloat transform_matrix[16],
+                                struct shader *shader, GLuint texture,
+                                const enum engine_render_pass pass);
+void engine_render_queue_submit_variant(const struct mesh *mesh,
+                                        const GLfloat transform_matrix[16],
+                                        struct shader_variants *variants,
+                                        const unsigned int features,
+                                        GLuint texture,
+                                        const enum engine_render_pass pass);
+void engine_render_queue_flush(void);
+struct engine_render_stats engine_render_stats_get(void);
+
+// frame pacing over a set of frames, in milliseconds. frames slower than
+// the budget count as over budget, those taking twice as long as hitches.
+#define ENGINE_FRAME_STATS_DEFAULT_BUDGET (1000.0 / 60.0)
+struct engine_frame_stats {
+  unsigned long frames;
+  double avg_ms;
+  double p50_ms;
+  double p95_ms;
+  double p99_ms;
+  double max_ms;
+  double budget_ms;
+  unsigned long over_budget;
+  unsigned long hitches;
+};
+
+void engine_frame_stats_budget_set(const double budget_ms);
+void engine_frame_stats_record(const double delta);
+struct engine_frame_stats engine_frame_stats_window(void);
+struct engine_frame_stats engine_frame_stats_session(void);
+void engine_frame_stats_report(void);
+bool engine_frame_stats_write_csv(const char *path);
+
+void engine_profiler_begin(const char *name);
+void engine_profiler_end(void);
+void engine_profiler_thread_name(const char *name);
+void engine_profiler_frame_begin(void);
+unsigned long engine_profiler_frame(void);
+bool engine_profiler_capture(const unsigned long first_frame,
+                             const unsigned long frames_count,
+                             const char *path);
+
+// GPU time spent in a named scope, over the frames it was recorded in.
+#define ENGINE_GPU_PROFILER_SCOPES_MAX (32)
+struct engine_gpu_scope_stats {
+  const char *name;
+  unsigned long samples;
+  double last_ms;
+  double min_ms;
+  double avg_ms;
+  double max_ms;
+  double total_ms;
+};
+
+void engine_gpu_profiler_alloc(void);
+void engine_gpu_profiler_free(void);
+bool engine_gpu_profiler_is_enabled(void);
+void engine_gpu_profiler_frame_begin(void);
+void engine_gpu_profiler_frame_end(void);
+void engine_gpu_profiler_begin(const char *name);
+void engine_gpu_profiler_end(void);
+unsigned int engine_gpu_profiler_scopes_count(void);
+struct engine_gpu_scope_stats
+engine_gpu_profiler_scope_get(const unsigned int index);
+void engine_gpu_profiler_report(void);
+bool engine_gpu_profiler_write_csv(FILE *file);
+
+// called with the number of each frame whose timings were read back, right
+// after they are added to the scope statistics.
+typedef void (*engine_gpu_profiler_collect_fn)(const unsigned long frame,
+                                               void *user_data);
+void engine_gpu_profiler_register_callback(
+    engine_gpu_profiler_collect_fn callback, void *user_data);
+unsigned long engine_gpu_profiler_frame(void);
+void engine_gpu_profiler_flush(void);
+
+// a fixed timestep run recording per frame timings and draw counts. see
+// engine_benchmark.c
+#define ENGINE_BENCHMARK_DELTA (1.0 / 60.0 /* seconds */)
+struct engine_benchmark_frame {
+  unsigned long frame;
+  double frame_ms;
+  double cpu_ms;
+  // negative when the GPU timings of the frame were not read back.
+  double gpu_ms;
+  unsigned long gpu_frame;
+  struct engine_render_stats render;
+};
+typedef struct engine_benchmark_frame engine_benchmark_frame;
+
+void engine_benchmark_begin(const char *scene, const char *gpu_scope);
+void engine_benchmark_end(void);
+bool engine_benchmark_is_running(void);
+double engine_benchmark_time(void);
+void engine_benchmark_frame_begin(void);
+void engine_benchmark_frame_end(void);
+bool engine_benchmark_write(const char *path);
 
 GLuint engine_texture_alloc(const char *imageFile);
+GLuint engine_texture_cube_alloc(const char *imageFile);
+GLenum engine_texture_target(GLuint texture);
 void engine_texture_free(GLuint texture);
 
 void engine_scene_load(void);
@@ -245,11 +676,4 @@ bool engine_key_get(int keycode);
 void engine_mouse_delta_get(float *x, float *y);
 void engine_mouse_position_get(float *x, float *y);
 
-typedef struct vec2 vec2;
-typedef struct vec3 vec3;
-
-DECLARE_LIST(vec2)
-DECLARE_LIST(vec3)
-DECLARE_LIST(GLuint)
-
 #endif // ENGINE_H
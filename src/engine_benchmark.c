@@ -0,0 +1,183 @@
+#include "engine.h"
+
+#include <string.h>
+#include <time.h>
+
+// Benchmark runs. While one is running the scene is simulated with a fixed
+// step of ENGINE_BENCHMARK_DELTA per frame, whatever the frame took, so a
+// run always draws the same frames. For every frame the wall clock frame
+// time, the CPU time from frame_begin to frame_end (simulating and queuing
+// draws, without the buffer swap), the GPU time of one profiler scope and
+// the render queue's draw counts are kept, and written as JSON at the end.
+// GPU times arrive a few frames late, through the GPU profiler's collect
+// callback, and are matched to their frame by the profiler frame number.
+
+DECLARE_AND_DEFINE_LIST(engine_benchmark_frame)
+
+static struct {
+  bool is_running;
+  const char *scene;
+  const char *gpu_scope;
+  list_engine_benchmark_frame frames;
+  double frame_begin;
+  double cpu_begin;
+} engine_benchmark = {0};
+
+static double engine_benchmark_clock(void) {
+  struct timespec spec;
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+  return spec.tv_sec + spec.tv_nsec * 1e-9;
+}
+
+static void engine_benchmark_gpu_collect(const unsigned long gpu_frame,
+                                         void *user_data) {
+  (void)user_data;
+  for (unsigned int i = 0; i < engine_gpu_profiler_scopes_count(); i++) {
+    const struct engine_gpu_scope_stats scope =
+        engine_gpu_profiler_scope_get(i);
+    if (strcmp(scope.name, engine_benchmark.gpu_scope) != 0) {
+      continue;
+    }
+    // the frame is one of the last few recorded.
+    for (list_size j = list_engine_benchmark_frame_count(
+             engine_benchmark.frames);
+         j-- > 0;) {
+      if (engine_benchmark.frames[j].gpu_frame == gpu_frame) {
+        engine_benchmark.frames[j].gpu_ms = scope.last_ms;
+        break;
+      }
+      if (engine_benchmark.frames[j].gpu_frame < gpu_frame) {
+        break;
+      }
+    }
+    return;
+  }
+}
+
+// starts recording the frames of 'scene'. the GPU time of each frame is
+// taken from the GPU profiler scope named 'gpu_scope'.
+void engine_benchmark_begin(const char *scene, const char *gpu_scope) {
+  if (engine_benchmark.frames == NULL) {
+    engine_benchmark.frames = list_engine_benchmark_frame_alloc();
+  }
+  list_engine_benchmark_frame_clear(engine_benchmark.frames);
+  engine_benchmark.scene = scene;
+  engine_benchmark.gpu_scope = gpu_scope;
+  engine_benchmark.frame_begin = 0;
+  engine_benchmark.is_running = true;
+  engine_gpu_profiler_register_callback(engine_benchmark_gpu_collect, NULL);
+  engine_log("benchmarking scene '%s'", scene);
+}
+
+// stops recording. the frames still in flight on the GPU are read back
+// first.
+void engine_benchmark_end(void) {
+  if (!engine_benchmark.is_running) {
+    return;
+  }
+  engine_gpu_profiler_flush();
+  engine_gpu_profiler_register_callback(NULL, NULL);
+  engine_benchmark.is_running = false;
+}
+
+bool engine_benchmark_is_running(void) { return engine_benchmark.is_running; }
+
+// simulated seconds since the run started.
+double engine_benchmark_time(void) {
+  if (engine_benchmark.frames == NULL) {
+    return 0;
+  }
+  return list_engine_benchmark_frame_count(engine_benchmark.frames) *
+         ENGINE_BENCHMARK_DELTA;
+}
+
+// call at the start of each frame, before the scene is updated.
+void engine_benchmark_frame_begin(void) {
+  if (!engine_benchmark.is_running) {
+    return;
+  }
+  const double now = engine_benchmark_clock();
+  const list_size count =
+      list_engine_benchmark_frame_count(engine_benchmark.frames);
+  // the first frame has no previous one to measure from.
+  if (count > 0) {
+    engine_benchmark.frames[count - 1].frame_ms =
+        (now - engine_benchmark.frame_begin) * 1e3;
+  }
+  engine_benchmark.frame_begin = now;
+  engine_benchmark.cpu_begin = now;
+}
+
+// call once the frame's draws are submitted, before the buffer swap.
+void engine_benchmark_frame_end(void) {
+  if (!engine_benchmark.is_running) {
+    return;
+  }
+  const struct engine_benchmark_frame frame = {
+      .frame = list_engine_benchmark_frame_count(engine_benchmark.frames),
+      .frame_ms = -1,
+      .cpu_ms = (engine_benchmark_clock() - engine_benchmark.cpu_begin) * 1e3,
+      .gpu_ms = -1,
+      .gpu_frame = engine_gpu_profiler_frame(),
+      .render = engine_render_stats_get(),
+  };
+  list_engine_benchmark_frame_add(&engine_benchmark.frames, frame);
+}
+
+static void engine_benchmark_json_number(FILE *file, const char *name,
+                                         const double value) {
+  if (value < 0) {
+    fprintf(file, ",\"%s\":null", name);
+  } else {
+    fprintf(file, ",\"%s\":%.4f", name, value);
+  }
+}
+
+// writes the recorded frames to 'path' as
+//   {"scene":..., "renderer":..., "delta":..., "frames":[{...}, ...]}
+// with one object per frame. times are in milliseconds and null where they
+// were not measured.
+bool engine_benchmark_write(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    engine_error("failed to open benchmark file '%s'", path);
+    return false;
+  }
+
+  // the renderer string comes from the driver. quotes in it would break the
+  // file.
+  const char *renderer = (const char *)glGetString(GL_RENDERER);
+  fprintf(file, "{\"scene\":\"%s\",\"renderer\":\"", engine_benchmark.scene);
+  for (const char *c = renderer != NULL ? renderer : ""; *c != '\0'; c++) {
+    fputc(*c == '"' || *c == '\\' ? '_' : *c, file);
+  }
+  fprintf(file, "\",\"delta\":%.6f,\"frames\":[\n", ENGINE_BENCHMARK_DELTA);
+
+  const list_size count = engine_benchmark.frames != NULL
+                              ? list_engine_benchmark_frame_count(
+                                    engine_benchmark.frames)
+                              : 0;
+  for (list_size i = 0; i < count; i++) {
+    const struct engine_benchmark_frame *frame = &engine_benchmark.frames[i];
+    fprintf(file, "{\"frame\":%lu", frame->frame);
+    engine_benchmark_json_number(file, "frame_ms", frame->frame_ms);
+    engine_benchmark_json_number(file, "cpu_ms", frame->cpu_ms);
+    engine_benchmark_json_number(file, "gpu_ms", frame->gpu_ms);
+    fprintf(file,
+            ",\"draw_calls\":%u,\"instances\":%u,\"triangles\":%lu,"
+            "\"program_changes\":%u}%s\n",
+            frame->render.draw_calls, frame->render.instances,
+            frame->render.triangles, frame->render.program_changes,
+            i + 1 < count ? "," : "");
+  }
+  fprintf(file, "]}\n");
+
+  const bool has_error = ferror(file);
+  const bool is_written = fclose(file) == 0 && !has_error;
+  if (!is_written) {
+    engine_error("failed to write benchmark file '%s'", path);
+  } else {
+    engine_log("wrote %zu benchmark frames to '%s'", (size_t)count, path);
+  }
+  return is_written;
+}
@@ -8,20 +8,97 @@ struct camera camera_alloc(void) {
               .rotation = (struct quat){0, 0, 0, 1},
               .scale = (vec3){1, 1, 1},
           },
+      .origin = (struct vec3d){0, 0, 0},
       .matrix = calloc(16, sizeof(GLfloat)),
+      .fov = 70 * (3.14159 / 180.0),
+      .near = 0.0001,
+      .far = 1000,
+      .depth_mode = CAMERA_DEPTH_STANDARD,
   };
 }
 
+static bool camera_depth_buffer_is_float(void) {
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+  GLint component_type = GL_NONE;
+  glGetFramebufferAttachmentParameteriv(
+      GL_FRAMEBUFFER, framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT,
+      GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &component_type);
+  return component_type == GL_FLOAT;
+}
+
+// whether 'mode' works with the bound framebuffer. reversed-Z only helps
+// with a floating point depth buffer, which the default framebuffer of a
+// window usually lacks, and needs glClipControl.
+bool camera_depth_mode_is_supported(enum camera_depth_mode mode) {
+  if (mode != CAMERA_DEPTH_REVERSED_Z) {
+    return true;
+  }
+  return glad_glClipControl != NULL && camera_depth_buffer_is_float();
+}
+
+// selects how the camera maps distance to depth and sets up the matching
+// depth state. an unsupported reversed-Z falls back to logarithmic depth.
+void camera_depth_mode_set(struct camera *camera, enum camera_depth_mode mode) {
+  const bool has_clip_control = glad_glClipControl != NULL;
+
+  if (!camera_depth_mode_is_supported(mode)) {
+    engine_warn("reversed-Z needs glClipControl and a float depth buffer, "
+                "falling back to logarithmic depth");
+    mode = CAMERA_DEPTH_LOGARITHMIC;
+  }
+
+  if (mode == CAMERA_DEPTH_REVERSED_Z) {
+    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+    glClearDepth(0.0);
+    glDepthFunc(GL_GREATER);
+  } else {
+    if (has_clip_control) {
+      glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+    }
+    glClearDepth(1.0);
+    glDepthFunc(GL_LESS);
+  }
+
+  camera->depth_mode = mode;
+}
+
+// moves the camera's render origin to its current position. everything drawn
+// afterwards is relative to the camera itself, so only the camera is shifted
+// and no other object needs to be touched.
+void camera_recenter(struct camera *camera) {
+  vec3d_add(&camera->origin, vec3d_from_vec3(camera->transform.position));
+  camera->transform.position = vec3_zero();
+}
+
+struct vec3d camera_world_position(const struct camera *camera) {
+  return vec3d_added(camera->origin,
+                     vec3d_from_vec3(camera->transform.position));
+}
+
 void camera_update(struct camera *camera) {
 
   const GLfloat aspect = engine_get_aspect_ratio();
 
   GLfloat projection[16];
   mathf_mat4_identity(projection);
-  mathf_mat4_perspective(projection, 70 * (3.14159 / 180.0), aspect, 0.0001,
-                         1000);
+  if (camera->depth_mode == CAMERA_DEPTH_REVERSED_Z) {
+    mathf_mat4_perspective_reversed_infinite(projection, camera->fov, aspect,
+                                             camera->near);
+  } else {
+    mathf_mat4_perspective(projection, camera->fov, aspect, camera->near,
+                           camera->far);
+  }
   // mat4_orthographic(projection, -9, 9, -16, 16, 0.1, 75);
 
+  // the vertex shaders remap depth to log2(1 + w) * u_log_depth - 1 when this
+  // coefficient is non-zero.
+  camera->log_depth_coefficient =
+      camera->depth_mode == CAMERA_DEPTH_LOGARITHMIC
+          ? 2.0 / log2(camera->far + 1.0)
+          : 0.0;
+
   vec3 offset = vec3_rotate((vec3){0, 0, -1}, camera->transform.rotation);
 
   GLfloat translation_matrix[16];
@@ -37,3 +114,12 @@ void camera_update(struct camera *camera) {
   mathf_mat4_multiply(camera->matrix, translation_matrix, rotation_matrix);
   mathf_mat4_multiply(camera->matrix, camera->matrix, projection);
 }
+
+// returns the planes of the camera's view frustum. like the camera matrix they
+// are relative to the camera origin.
+struct frustum camera_frustum(const struct camera *camera) {
+  struct frustum frustum;
+  mathf_frustum_from_matrix(&frustum, camera->matrix,
+                            camera->depth_mode == CAMERA_DEPTH_REVERSED_Z);
+  return frustum;
+}
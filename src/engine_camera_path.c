@@ -0,0 +1,122 @@
+#include "engine.h"
+
+#include <string.h>
+
+// Camera paths for repeatable fly-throughs. A path is a list of timed poses,
+// either built in code or recorded from a play session and saved as text,
+// one key per line:
+//   time x y z qx qy qz qw
+// Positions are interpolated with a Catmull-Rom spline, so the camera passes
+// through every key without sharp turns, and rotations with nlerp.
+
+DEFINE_LIST(camera_path_key)
+
+double camera_path_duration(const list_camera_path_key keys) {
+  const list_size count = keys != NULL ? list_camera_path_key_count(keys) : 0;
+  return count > 0 ? keys[count - 1].time : 0;
+}
+
+// the pose at 'time' seconds, clamped to the ends of the path. keys must be
+// sorted by time.
+void camera_path_sample(const list_camera_path_key keys, const double time,
+                        struct vec3d *position, struct quat *rotation) {
+  const list_size count = keys != NULL ? list_camera_path_key_count(keys) : 0;
+  if (count == 0) {
+    return;
+  }
+  if (count == 1 || time <= keys[0].time) {
+    *position = keys[0].position;
+    *rotation = keys[0].rotation;
+    return;
+  }
+  if (time >= keys[count - 1].time) {
+    *position = keys[count - 1].position;
+    *rotation = keys[count - 1].rotation;
+    return;
+  }
+
+  list_size i = 1;
+  while (keys[i].time < time) {
+    i++;
+  }
+  const struct camera_path_key *from = &keys[i - 1];
+  const struct camera_path_key *to = &keys[i];
+  const double span = to->time - from->time;
+  const double t = span > 0 ? (time - from->time) / span : 1;
+
+  // the end keys stand in for the missing neighbours.
+  const struct vec3d before = keys[i > 1 ? i - 2 : 0].position;
+  const struct vec3d after = keys[i + 1 < count ? i + 1 : i].position;
+  *position = vec3d_catmull_rom(before, from->position, to->position, after, t);
+  *rotation = quat_nlerp(from->rotation, to->rotation, t);
+}
+
+// reads a path saved by camera_path_save. lines starting with '#' are
+// comments. returns NULL if the file cannot be read or holds no keys.
+list_camera_path_key camera_path_load(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    engine_error("failed to open camera path '%s'", path);
+    return NULL;
+  }
+
+  list_camera_path_key keys = list_camera_path_key_alloc();
+  char line[256];
+  unsigned int line_number = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_number++;
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+      continue;
+    }
+
+    struct camera_path_key key;
+    if (sscanf(line, "%lf %lf %lf %lf %f %f %f %f", &key.time,
+               &key.position.x, &key.position.y, &key.position.z,
+               &key.rotation.x, &key.rotation.y, &key.rotation.z,
+               &key.rotation.w) != 8) {
+      engine_warn("skipping malformed camera path key at '%s':%u", path,
+                  line_number);
+      continue;
+    }
+    const list_size count = list_camera_path_key_count(keys);
+    if (count > 0 && key.time < keys[count - 1].time) {
+      engine_warn("skipping camera path key out of order at '%s':%u", path,
+                  line_number);
+      continue;
+    }
+    key.rotation = quat_normalized(key.rotation);
+    list_camera_path_key_add(&keys, key);
+  }
+  fclose(file);
+
+  if (list_camera_path_key_count(keys) == 0) {
+    engine_error("camera path '%s' has no keys", path);
+    list_camera_path_key_free(keys);
+    return NULL;
+  }
+  return keys;
+}
+
+bool camera_path_save(const list_camera_path_key keys, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    engine_error("failed to open camera path '%s'", path);
+    return false;
+  }
+
+  bool is_written = fprintf(file, "# time x y z qx qy qz qw\n") > 0;
+  const list_size count = keys != NULL ? list_camera_path_key_count(keys) : 0;
+  for (list_size i = 0; i < count && is_written; i++) {
+    const struct camera_path_key *key = &keys[i];
+    is_written = fprintf(file, "%.4f %.6f %.6f %.6f %.7f %.7f %.7f %.7f\n",
+                         key->time, key->position.x, key->position.y,
+                         key->position.z, key->rotation.x, key->rotation.y,
+                         key->rotation.z, key->rotation.w) > 0;
+  }
+  is_written = fclose(file) == 0 && is_written;
+
+  if (!is_written) {
+    engine_error("failed to write camera path '%s'", path);
+  }
+  return is_written;
+}
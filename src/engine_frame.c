@@ -0,0 +1,48 @@
+#include "engine.h"
+
+// Per-frame constants shared by every program through the std140
+// 'engine_frame' uniform block. They are written into a stream buffer, so
+// each frame gets its own region and the CPU never overwrites data the GPU
+// may still be reading from a previous frame.
+
+static struct {
+  struct engine_stream_buffer stream;
+  GLsizeiptr alignment;
+} engine_frame = {0};
+
+void engine_frame_constants_alloc(void) {
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  if (alignment <= 0) {
+    alignment = 256;
+  }
+
+  const GLsizeiptr size = sizeof(struct engine_frame_constants);
+  engine_frame.alignment = alignment;
+  engine_frame.stream = engine_stream_buffer_alloc(
+      GL_UNIFORM_BUFFER, (size + alignment - 1) / alignment * alignment);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void engine_frame_constants_free(void) {
+  engine_stream_buffer_free(&engine_frame.stream);
+}
+
+// uploads this frame's constants and binds them to
+// ENGINE_UNIFORM_BLOCK_FRAME. call once per frame, before drawing.
+void engine_frame_constants_update(
+    const struct engine_frame_constants *constants) {
+  GLintptr offset = 0;
+  void *data = engine_stream_buffer_map(&engine_frame.stream,
+                                        sizeof(*constants),
+                                        engine_frame.alignment, &offset);
+  if (data == NULL) {
+    engine_error("failed to map frame constants");
+    return;
+  }
+  *(struct engine_frame_constants *)data = *constants;
+  engine_stream_buffer_unmap(&engine_frame.stream);
+
+  glBindBufferRange(GL_UNIFORM_BUFFER, ENGINE_UNIFORM_BLOCK_FRAME,
+                    engine_frame.stream.buffer, offset, sizeof(*constants));
+}
@@ -0,0 +1,146 @@
+#include "engine.h"
+
+#include <string.h>
+
+// Frame pacing statistics. Every frame time is kept for the session, so the
+// summary and the CSV cover the whole run, and the last
+// ENGINE_FRAME_STATS_WINDOW frames also go into a ring for rolling
+// percentiles. Percentiles use the nearest-rank method on a sorted copy and
+// are only computed when asked for.
+
+#define ENGINE_FRAME_STATS_WINDOW (1024 /* frames */)
+
+// a frame taking this many budgets or more counts as a hitch.
+#define ENGINE_FRAME_STATS_HITCH_FACTOR (2.0)
+
+DECLARE_AND_DEFINE_LIST(float)
+
+static struct {
+  list_float frame_times;
+  float window[ENGINE_FRAME_STATS_WINDOW];
+  unsigned long window_count;
+  double budget_ms;
+} engine_frame_stats = {
+    .budget_ms = ENGINE_FRAME_STATS_DEFAULT_BUDGET,
+};
+
+void engine_frame_stats_budget_set(const double budget_ms) {
+  engine_frame_stats.budget_ms = budget_ms;
+}
+
+// records a frame that took 'delta' seconds.
+void engine_frame_stats_record(const double delta) {
+  if (engine_frame_stats.frame_times == NULL) {
+    engine_frame_stats.frame_times = list_float_alloc();
+  }
+  const float ms = delta * 1e3;
+  list_float_add(&engine_frame_stats.frame_times, ms);
+  engine_frame_stats.window[engine_frame_stats.window_count++ %
+                            ENGINE_FRAME_STATS_WINDOW] = ms;
+}
+
+static int engine_frame_stats_compare(const void *a, const void *b) {
+  const float time_a = *(const float *)a;
+  const float time_b = *(const float *)b;
+  return (time_a > time_b) - (time_a < time_b);
+}
+
+// nearest-rank percentile 'p' of 'count' sorted frame times.
+static double engine_frame_stats_percentile(const float *sorted,
+                                            const size_t count,
+                                            const double p) {
+  size_t rank = (size_t)(p / 100.0 * count + 0.999999);
+  rank = rank < 1 ? 1 : rank > count ? count : rank;
+  return sorted[rank - 1];
+}
+
+static struct engine_frame_stats
+engine_frame_stats_compute(const float *frame_times, const size_t count) {
+  struct engine_frame_stats stats = {
+      .frames = count,
+      .budget_ms = engine_frame_stats.budget_ms,
+  };
+  if (count == 0) {
+    return stats;
+  }
+
+  float *sorted = malloc(count * sizeof(*sorted));
+  memcpy(sorted, frame_times, count * sizeof(*sorted));
+  qsort(sorted, count, sizeof(*sorted), engine_frame_stats_compare);
+
+  double total_ms = 0;
+  for (size_t i = 0; i < count; i++) {
+    total_ms += sorted[i];
+    if (sorted[i] > stats.budget_ms) {
+      stats.over_budget++;
+    }
+    if (sorted[i] >= stats.budget_ms * ENGINE_FRAME_STATS_HITCH_FACTOR) {
+      stats.hitches++;
+    }
+  }
+
+  stats.avg_ms = total_ms / count;
+  stats.p50_ms = engine_frame_stats_percentile(sorted, count, 50);
+  stats.p95_ms = engine_frame_stats_percentile(sorted, count, 95);
+  stats.p99_ms = engine_frame_stats_percentile(sorted, count, 99);
+  stats.max_ms = sorted[count - 1];
+
+  free(sorted);
+  return stats;
+}
+
+// statistics of the last ENGINE_FRAME_STATS_WINDOW frames.
+struct engine_frame_stats engine_frame_stats_window(void) {
+  const size_t count =
+      engine_frame_stats.window_count < ENGINE_FRAME_STATS_WINDOW
+          ? engine_frame_stats.window_count
+          : ENGINE_FRAME_STATS_WINDOW;
+  return engine_frame_stats_compute(engine_frame_stats.window, count);
+}
+
+// statistics of every frame recorded so far.
+struct engine_frame_stats engine_frame_stats_session(void) {
+  if (engine_frame_stats.frame_times == NULL) {
+    return engine_frame_stats_compute(NULL, 0);
+  }
+  return engine_frame_stats_compute(
+      engine_frame_stats.frame_times,
+      list_float_count(engine_frame_stats.frame_times));
+}
+
+void engine_frame_stats_report(void) {
+  const struct engine_frame_stats stats = engine_frame_stats_session();
+  if (stats.frames == 0) {
+    return;
+  }
+  engine_log("frame times over %lu frames: avg %.2f p50 %.2f p95 %.2f p99 "
+             "%.2f max %.2f ms",
+             stats.frames, stats.avg_ms, stats.p50_ms, stats.p95_ms,
+             stats.p99_ms, stats.max_ms);
+  engine_log("%lu frames over the %.2f ms budget, %lu hitches",
+             stats.over_budget, stats.budget_ms, stats.hitches);
+}
+
+// writes the time of every recorded frame, one row per frame.
+bool engine_frame_stats_write_csv(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    engine_error("failed to open frame time file '%s'", path);
+    return false;
+  }
+
+  bool is_written = fprintf(file, "frame,ms\n") > 0;
+  const list_size count = engine_frame_stats.frame_times != NULL
+                              ? list_float_count(engine_frame_stats.frame_times)
+                              : 0;
+  for (list_size i = 0; i < count && is_written; i++) {
+    is_written = fprintf(file, "%zu,%.3f\n", i,
+                         engine_frame_stats.frame_times[i]) > 0;
+  }
+  is_written = fclose(file) == 0 && is_written;
+
+  if (!is_written) {
+    engine_error("failed to write frame time file '%s'", path);
+  }
+  return is_written;
+}
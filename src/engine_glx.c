@@ -22,6 +22,12 @@ struct engine_window engine_window_instance = {
 };
 
 bool engine_start(void) {
+#ifdef ENGINE_HEADLESS
+  if (engine_is_headless()) {
+    return engine_headless_start();
+  }
+#endif // ENGINE_HEADLESS
+
   engine_window_instance.display = XOpenDisplay(NULL);
   if (engine_window_instance.display == NULL) {
     engine_error("cannot connect to X server");
@@ -110,6 +116,13 @@ bool engine_start(void) {
 }
 
 void engine_stop(void) {
+#ifdef ENGINE_HEADLESS
+  if (engine_is_headless()) {
+    engine_headless_stop();
+    return;
+  }
+#endif // ENGINE_HEADLESS
+
   glXMakeCurrent(engine_window_instance.display, 0, 0);
   glXDestroyContext(engine_window_instance.display,
                     engine_window_instance.context);
@@ -132,6 +145,12 @@ static float mouse_x_delta = 0;
 static float mouse_y_delta = 0;
 
 bool engine_key_get(int keysym) {
+#ifdef ENGINE_HEADLESS
+  if (engine_is_headless()) {
+    return false;
+  }
+#endif // ENGINE_HEADLESS
+
   const KeyCode keycode =
       XKeysymToKeycode(engine_window_instance.display, keysym);
   return input_keys[keycode];
@@ -148,7 +167,20 @@ void engine_mouse_delta_get(float *x, float *y) {
 }
 
 void engine_update(void) {
+#ifdef ENGINE_HEADLESS
+  if (engine_is_headless()) {
+    engine_profiler_begin("flush");
+    engine_headless_update();
+    engine_profiler_end();
+    return;
+  }
+#endif // ENGINE_HEADLESS
+
+  engine_profiler_begin("swap buffers");
   glXSwapBuffers(engine_window_instance.display, engine_window_instance.window);
+  engine_profiler_end();
+
+  engine_profiler_begin("events");
 
   const int window_center_x = engine_window_instance.window_width / 2;
   const int window_center_y = engine_window_instance.window_height / 2;
@@ -222,14 +254,27 @@ void engine_update(void) {
     } break;
     }
   }
+  engine_profiler_end();
 }
 
 float engine_get_aspect_ratio(void) {
+#ifdef ENGINE_HEADLESS
+  if (engine_is_headless()) {
+    return engine_headless_aspect_ratio();
+  }
+#endif // ENGINE_HEADLESS
+
   return (float)engine_window_instance.window_width /
          engine_window_instance.window_height;
 }
 
 bool engine_is_running(void) {
+#ifdef ENGINE_HEADLESS
+  if (engine_is_headless()) {
+    return engine_headless_is_running();
+  }
+#endif // ENGINE_HEADLESS
+
   return engine_window_instance.engine_is_running;
 }
 
@@ -0,0 +1,297 @@
+#include "engine.h"
+
+#include <string.h>
+
+// GPU timings of named scopes. Each scope instance writes a GL_TIMESTAMP at
+// its begin and end, so scopes can nest, which GL_TIME_ELAPSED queries
+// cannot. Queries of a frame are only read back when its slot in the ring
+// comes around again, by which time the GPU has normally finished them; a
+// frame whose results are still not available is dropped rather than
+// waited for. Times of a scope opened several times in one frame are added
+// up, and min/avg/max are taken over frames.
+
+#define ENGINE_GPU_PROFILER_FRAMES (ENGINE_FRAME_RING_SIZE + 1)
+#define ENGINE_GPU_PROFILER_INSTANCES_MAX (128 /* per frame */)
+#define ENGINE_GPU_PROFILER_DEPTH_MAX (16)
+
+struct engine_gpu_profiler_frame {
+  // begin and end timestamps of each scope instance, interleaved.
+  GLuint queries[2 * ENGINE_GPU_PROFILER_INSTANCES_MAX];
+  unsigned int scopes[ENGINE_GPU_PROFILER_INSTANCES_MAX];
+  unsigned int instances_count;
+  // the query written last, whose result is available last.
+  GLuint last_query;
+  // the engine_gpu_profiler_frame number the queries were recorded in.
+  unsigned long number;
+  bool is_pending;
+};
+
+static struct {
+  bool is_enabled;
+  struct engine_gpu_profiler_frame frames[ENGINE_GPU_PROFILER_FRAMES];
+  unsigned long frame;
+  struct engine_gpu_scope_stats scopes[ENGINE_GPU_PROFILER_SCOPES_MAX];
+  unsigned int scopes_count;
+  // open scope instances of the current frame, innermost last.
+  // instances that could not be recorded are pushed as
+  // ENGINE_GPU_PROFILER_INSTANCES_MAX, or only counted in 'overflow' once the
+  // stack is full, so their ends still match up.
+  unsigned int stack[ENGINE_GPU_PROFILER_DEPTH_MAX];
+  unsigned int stack_depth;
+  unsigned int overflow;
+  bool is_full_reported;
+  unsigned long dropped_frames;
+  engine_gpu_profiler_collect_fn callback;
+  void *callback_user_data;
+} engine_gpu_profiler = {0};
+
+void engine_gpu_profiler_alloc(void) {
+  if (engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  if (glad_glQueryCounter == NULL) {
+    engine_warn("timer queries are not supported, GPU profiling disabled");
+    return;
+  }
+  for (unsigned int i = 0; i < ENGINE_GPU_PROFILER_FRAMES; i++) {
+    glGenQueries(2 * ENGINE_GPU_PROFILER_INSTANCES_MAX,
+                 engine_gpu_profiler.frames[i].queries);
+  }
+  engine_gpu_profiler.is_enabled = true;
+}
+
+void engine_gpu_profiler_free(void) {
+  if (!engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  for (unsigned int i = 0; i < ENGINE_GPU_PROFILER_FRAMES; i++) {
+    glDeleteQueries(2 * ENGINE_GPU_PROFILER_INSTANCES_MAX,
+                    engine_gpu_profiler.frames[i].queries);
+  }
+  engine_gpu_profiler.is_enabled = false;
+  engine_gpu_profiler.is_full_reported = false;
+  engine_gpu_profiler.scopes_count = 0;
+  engine_gpu_profiler.dropped_frames = 0;
+  for (unsigned int i = 0; i < ENGINE_GPU_PROFILER_FRAMES; i++) {
+    engine_gpu_profiler.frames[i].is_pending = false;
+  }
+}
+
+bool engine_gpu_profiler_is_enabled(void) {
+  return engine_gpu_profiler.is_enabled;
+}
+
+static struct engine_gpu_profiler_frame *engine_gpu_profiler_slot(void) {
+  return &engine_gpu_profiler
+              .frames[engine_gpu_profiler.frame % ENGINE_GPU_PROFILER_FRAMES];
+}
+
+// adds the results of 'frame' to the scope statistics, if they are ready.
+static void
+engine_gpu_profiler_collect(struct engine_gpu_profiler_frame *frame) {
+  frame->is_pending = false;
+
+  GLint is_available = GL_FALSE;
+  glGetQueryObjectiv(frame->last_query, GL_QUERY_RESULT_AVAILABLE,
+                     &is_available);
+  if (!is_available) {
+    engine_gpu_profiler.dropped_frames++;
+    return;
+  }
+
+  double frame_ms[ENGINE_GPU_PROFILER_SCOPES_MAX] = {0};
+  bool is_sampled[ENGINE_GPU_PROFILER_SCOPES_MAX] = {false};
+  for (unsigned int i = 0; i < frame->instances_count; i++) {
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(frame->queries[2 * i], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame->queries[2 * i + 1], GL_QUERY_RESULT, &end);
+    frame_ms[frame->scopes[i]] += (end > begin ? end - begin : 0) * 1e-6;
+    is_sampled[frame->scopes[i]] = true;
+  }
+
+  for (unsigned int i = 0; i < engine_gpu_profiler.scopes_count; i++) {
+    if (!is_sampled[i]) {
+      continue;
+    }
+    struct engine_gpu_scope_stats *scope = &engine_gpu_profiler.scopes[i];
+    const double ms = frame_ms[i];
+    scope->last_ms = ms;
+    scope->min_ms = scope->samples == 0 || ms < scope->min_ms ? ms
+                                                              : scope->min_ms;
+    scope->max_ms = ms > scope->max_ms ? ms : scope->max_ms;
+    scope->total_ms += ms;
+    scope->samples++;
+  }
+
+  if (engine_gpu_profiler.callback != NULL) {
+    engine_gpu_profiler.callback(frame->number,
+                                 engine_gpu_profiler.callback_user_data);
+  }
+}
+
+// starts recording a frame into the next slot of the ring, collecting the
+// results last recorded there first.
+void engine_gpu_profiler_frame_begin(void) {
+  if (!engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  engine_gpu_profiler.frame++;
+  struct engine_gpu_profiler_frame *frame = engine_gpu_profiler_slot();
+  if (frame->is_pending) {
+    engine_gpu_profiler_collect(frame);
+  }
+  frame->instances_count = 0;
+  frame->number = engine_gpu_profiler.frame;
+  engine_gpu_profiler.stack_depth = 0;
+  engine_gpu_profiler.overflow = 0;
+}
+
+void engine_gpu_profiler_frame_end(void) {
+  if (!engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  struct engine_gpu_profiler_frame *frame = engine_gpu_profiler_slot();
+  if (engine_gpu_profiler.stack_depth > 0 || engine_gpu_profiler.overflow > 0) {
+    engine_warn("%u GPU profiler scopes were not ended",
+                engine_gpu_profiler.stack_depth + engine_gpu_profiler.overflow);
+    engine_gpu_profiler.overflow = 0;
+    while (engine_gpu_profiler.stack_depth > 0) {
+      engine_gpu_profiler_end();
+    }
+  }
+  frame->is_pending = frame->instances_count > 0;
+}
+
+// the number of the frame being recorded, counting from 1.
+unsigned long engine_gpu_profiler_frame(void) {
+  return engine_gpu_profiler.frame;
+}
+
+// waits for the GPU and reads back every frame still in the ring, oldest
+// first. call after the last frame_end, so the final frames are not lost.
+void engine_gpu_profiler_flush(void) {
+  if (!engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  glFinish();
+  for (unsigned int i = 1; i <= ENGINE_GPU_PROFILER_FRAMES; i++) {
+    struct engine_gpu_profiler_frame *frame =
+        &engine_gpu_profiler.frames[(engine_gpu_profiler.frame + i) %
+                                    ENGINE_GPU_PROFILER_FRAMES];
+    if (frame->is_pending) {
+      engine_gpu_profiler_collect(frame);
+    }
+  }
+}
+
+void engine_gpu_profiler_register_callback(
+    engine_gpu_profiler_collect_fn callback, void *user_data) {
+  engine_gpu_profiler.callback = callback;
+  engine_gpu_profiler.callback_user_data = user_data;
+}
+
+static unsigned int engine_gpu_profiler_scope_find(const char *name) {
+  for (unsigned int i = 0; i < engine_gpu_profiler.scopes_count; i++) {
+    if (strcmp(engine_gpu_profiler.scopes[i].name, name) == 0) {
+      return i;
+    }
+  }
+  if (engine_gpu_profiler.scopes_count == ENGINE_GPU_PROFILER_SCOPES_MAX) {
+    return ENGINE_GPU_PROFILER_SCOPES_MAX;
+  }
+  // names are expected to be string literals and are not copied.
+  const unsigned int scope = engine_gpu_profiler.scopes_count++;
+  engine_gpu_profiler.scopes[scope] =
+      (struct engine_gpu_scope_stats){.name = name};
+  return scope;
+}
+
+// opens a scope named 'name' on the GPU timeline. scopes nest and must be
+// closed with engine_gpu_profiler_end within the same frame.
+void engine_gpu_profiler_begin(const char *name) {
+  if (!engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  struct engine_gpu_profiler_frame *frame = engine_gpu_profiler_slot();
+  const unsigned int scope = engine_gpu_profiler_scope_find(name);
+  if (engine_gpu_profiler.stack_depth == ENGINE_GPU_PROFILER_DEPTH_MAX) {
+    engine_gpu_profiler.overflow++;
+    return;
+  }
+  if (scope == ENGINE_GPU_PROFILER_SCOPES_MAX ||
+      frame->instances_count == ENGINE_GPU_PROFILER_INSTANCES_MAX) {
+    if (!engine_gpu_profiler.is_full_reported) {
+      engine_warn("GPU profiler is out of space for scope '%s'", name);
+      engine_gpu_profiler.is_full_reported = true;
+    }
+    engine_gpu_profiler.stack[engine_gpu_profiler.stack_depth++] =
+        ENGINE_GPU_PROFILER_INSTANCES_MAX;
+    return;
+  }
+
+  const unsigned int instance = frame->instances_count++;
+  frame->scopes[instance] = scope;
+  glQueryCounter(frame->queries[2 * instance], GL_TIMESTAMP);
+  engine_gpu_profiler.stack[engine_gpu_profiler.stack_depth++] = instance;
+}
+
+void engine_gpu_profiler_end(void) {
+  if (!engine_gpu_profiler.is_enabled ||
+      engine_gpu_profiler.stack_depth == 0) {
+    return;
+  }
+  if (engine_gpu_profiler.overflow > 0) {
+    engine_gpu_profiler.overflow--;
+    return;
+  }
+  struct engine_gpu_profiler_frame *frame = engine_gpu_profiler_slot();
+  const unsigned int instance =
+      engine_gpu_profiler.stack[--engine_gpu_profiler.stack_depth];
+  if (instance == ENGINE_GPU_PROFILER_INSTANCES_MAX) {
+    return;
+  }
+  frame->last_query = frame->queries[2 * instance + 1];
+  glQueryCounter(frame->last_query, GL_TIMESTAMP);
+}
+
+unsigned int engine_gpu_profiler_scopes_count(void) {
+  return engine_gpu_profiler.scopes_count;
+}
+
+struct engine_gpu_scope_stats engine_gpu_profiler_scope_get(
+    const unsigned int index) {
+  struct engine_gpu_scope_stats scope = engine_gpu_profiler.scopes[index];
+  scope.avg_ms = scope.samples > 0 ? scope.total_ms / scope.samples : 0;
+  return scope;
+}
+
+void engine_gpu_profiler_report(void) {
+  if (!engine_gpu_profiler.is_enabled) {
+    return;
+  }
+  engine_log("GPU scope timings in ms (%lu frames dropped):",
+             engine_gpu_profiler.dropped_frames);
+  for (unsigned int i = 0; i < engine_gpu_profiler.scopes_count; i++) {
+    const struct engine_gpu_scope_stats scope =
+        engine_gpu_profiler_scope_get(i);
+    engine_log("\t%-16s min %8.3f avg %8.3f max %8.3f (%lu frames)",
+               scope.name, scope.min_ms, scope.avg_ms, scope.max_ms,
+               scope.samples);
+  }
+}
+
+// writes one row per scope with the columns
+//   clock,scope,samples,min_ms,avg_ms,max_ms
+// where clock is "gpu", so CPU timings can be appended to the same table.
+bool engine_gpu_profiler_write_csv(FILE *file) {
+  for (unsigned int i = 0; i < engine_gpu_profiler.scopes_count; i++) {
+    const struct engine_gpu_scope_stats scope =
+        engine_gpu_profiler_scope_get(i);
+    if (fprintf(file, "gpu,%s,%lu,%.6f,%.6f,%.6f\n", scope.name,
+                scope.samples, scope.min_ms, scope.avg_ms,
+                scope.max_ms) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
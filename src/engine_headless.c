@@ -0,0 +1,164 @@
+#include "engine.h"
+
+#ifdef ENGINE_HEADLESS
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string.h>
+
+// Windowless backend for benchmarks and CI. The context is created through
+// EGL without any surface, on Mesa's surfaceless platform when it is
+// available, so no X server or GPU is needed: llvmpipe renders just as well.
+// Frames are drawn into a framebuffer object the size of the default window
+// and the scene loop stops after a fixed number of frames.
+
+struct engine_headless {
+  unsigned long frames_count;
+  unsigned long frame;
+  int width, height;
+  EGLDisplay display;
+  EGLContext context;
+  GLuint framebuffer;
+  GLuint color_renderbuffer;
+  GLuint depth_renderbuffer;
+};
+
+static struct engine_headless engine_headless_instance = {
+    .width = 640,
+    .height = 480,
+    .display = EGL_NO_DISPLAY,
+    .context = EGL_NO_CONTEXT,
+};
+
+// makes engine_start use the headless backend, drawing 'frames_count'
+// frames before engine_is_running returns false. 0 selects the window.
+void engine_headless_set(const unsigned long frames_count) {
+  engine_headless_instance.frames_count = frames_count;
+}
+
+bool engine_is_headless(void) {
+  return engine_headless_instance.frames_count > 0;
+}
+
+static EGLDisplay engine_headless_display(void) {
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+          "eglGetPlatformDisplayEXT");
+  if (extensions != NULL && get_platform_display != NULL &&
+      strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL) {
+    return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                EGL_DEFAULT_DISPLAY, NULL);
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool engine_headless_start(void) {
+  struct engine_headless *headless = &engine_headless_instance;
+
+  headless->display = engine_headless_display();
+  EGLint major, minor;
+  if (headless->display == EGL_NO_DISPLAY ||
+      !eglInitialize(headless->display, &major, &minor)) {
+    engine_error("Unable to initialize EGL.");
+    return false;
+  }
+  engine_log("Loaded EGL %d.%d", major, minor);
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    engine_error("EGL cannot create OpenGL contexts.");
+    return false;
+  }
+
+  // a core context of at least 3.3, which is what the shaders target. Mesa
+  // returns the newest core version it supports.
+  const EGLint context_attributes[] = {
+      EGL_CONTEXT_MAJOR_VERSION,
+      3,
+      EGL_CONTEXT_MINOR_VERSION,
+      3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE,
+  };
+  headless->context = eglCreateContext(headless->display, EGL_NO_CONFIG_KHR,
+                                       EGL_NO_CONTEXT, context_attributes);
+  if (headless->context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                      headless->context)) {
+    engine_error("Unable to create a surfaceless EGL context (0x%x).",
+                 eglGetError());
+    return false;
+  }
+
+  const int gl_version = gladLoadGL((GLADloadfunc)eglGetProcAddress);
+  if (!gl_version) {
+    engine_error("Unable to load GL.");
+    return false;
+  }
+  engine_log("Loaded GL %d.%d on %s", GLAD_VERSION_MAJOR(gl_version),
+             GLAD_VERSION_MINOR(gl_version), glGetString(GL_RENDERER));
+
+  glGenFramebuffers(1, &headless->framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, headless->framebuffer);
+
+  glGenRenderbuffers(1, &headless->color_renderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, headless->color_renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, headless->width,
+                        headless->height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, headless->color_renderbuffer);
+
+  // a float depth buffer, which is what reversed-z wants.
+  glGenRenderbuffers(1, &headless->depth_renderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, headless->depth_renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F,
+                        headless->width, headless->height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, headless->depth_renderbuffer);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    engine_error("Headless framebuffer is incomplete.");
+    return false;
+  }
+
+  glViewport(0, 0, headless->width, headless->height);
+  engine_log("rendering headless for %lu frames", headless->frames_count);
+  return true;
+}
+
+void engine_headless_stop(void) {
+  struct engine_headless *headless = &engine_headless_instance;
+  if (headless->context != EGL_NO_CONTEXT) {
+    glDeleteFramebuffers(1, &headless->framebuffer);
+    glDeleteRenderbuffers(1, &headless->color_renderbuffer);
+    glDeleteRenderbuffers(1, &headless->depth_renderbuffer);
+    eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    eglDestroyContext(headless->display, headless->context);
+    headless->context = EGL_NO_CONTEXT;
+  }
+  if (headless->display != EGL_NO_DISPLAY) {
+    eglTerminate(headless->display);
+    headless->display = EGL_NO_DISPLAY;
+  }
+}
+
+// stands in for the buffer swap: there is nothing to present, but the
+// frame's commands still have to reach the driver.
+void engine_headless_update(void) {
+  glFlush();
+  engine_headless_instance.frame++;
+}
+
+bool engine_headless_is_running(void) {
+  return engine_headless_instance.frame <
+         engine_headless_instance.frames_count;
+}
+
+float engine_headless_aspect_ratio(void) {
+  return (float)engine_headless_instance.width /
+         engine_headless_instance.height;
+}
+
+#endif // ENGINE_HEADLESS
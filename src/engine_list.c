@@ -3,3 +3,4 @@
 DEFINE_LIST(vec2)
 DEFINE_LIST(vec3)
 DEFINE_LIST(GLuint)
+DEFINE_LIST(GLint)
@@ -31,7 +31,9 @@ typedef struct {
                                                            list_size length);  \
                                                                                \
                 void list_##type##_remove_at(const list_##type list,           \
-                                             const list_size index);)
+                                             const list_size index);           \
+                                                                               \
+                void list_##type##_clear(const list_##type list);)
 
 #define DEFINE_LIST(type)                                                      \
                                                                                \
@@ -86,6 +88,13 @@ typedef struct {
         list_meta_data *data = ((list_meta_data *)(list)) - 1;                 \
         (list)[index] = (list)[data->count - 1];                               \
         data->count--;                                                         \
+      }                                                                        \
+                                                                               \
+      void list_##type##_clear(const list_##type list) {                       \
+        if (!list)                                                             \
+          return;                                                              \
+        list_meta_data *data = ((list_meta_data *)(list)) - 1;                 \
+        data->count = 0;                                                       \
       })
 
 #endif // ENGINE_LIST_H
@@ -2,6 +2,7 @@
 #define MATHF_H
 
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define MATHF_FLOAT_EPSILON (1e-4)
@@ -80,6 +81,21 @@ struct transform {
   struct vec3 scale;
 };
 
+// a double precision 3D vector used for world positions that are too large to
+// be represented accurately as floats.
+struct vec3d {
+  double x, y, z;
+};
+
+// a transform whose position is stored in double precision. it is converted
+// to a float model matrix relative to an origin (usually the camera) so that
+// objects at planetary distances render without jitter.
+struct transformd {
+  struct vec3d position;
+  struct quat rotation;
+  struct vec3 scale;
+};
+
 #define mathf_fmod fmodf
 #define mathf_fabs fabsf
 #define mathf_sin sinf
@@ -538,6 +554,75 @@ static inline float vec3_angle(struct vec3 v1, struct vec3 v2) {
   return acos(cos_theta); // Returns angle in radians
 }
 
+static inline void vec3d_add(struct vec3d *a, const struct vec3d b) {
+  a->x += b.x;
+  a->y += b.y;
+  a->z += b.z;
+}
+
+static inline struct vec3d vec3d_added(const struct vec3d a,
+                                       const struct vec3d b) {
+  return (struct vec3d){
+      a.x + b.x,
+      a.y + b.y,
+      a.z + b.z,
+  };
+}
+
+static inline struct vec3d vec3d_subbed(const struct vec3d a,
+                                        const struct vec3d b) {
+  return (struct vec3d){
+      a.x - b.x,
+      a.y - b.y,
+      a.z - b.z,
+  };
+}
+
+static inline struct vec3d vec3d_lerp(const struct vec3d a,
+                                      const struct vec3d b, const double t) {
+  return (struct vec3d){
+      a.x + (b.x - a.x) * t,
+      a.y + (b.y - a.y) * t,
+      a.z + (b.z - a.z) * t,
+  };
+}
+
+static inline struct vec3d vec3d_from_vec3(const struct vec3 v) {
+  return (struct vec3d){v.x, v.y, v.z};
+}
+
+// returns 'v' relative to 'origin'. the subtraction happens in double
+// precision and only the (small) result is rounded to float.
+static inline struct vec3 vec3d_relative(const struct vec3d v,
+                                         const struct vec3d origin) {
+  return (struct vec3){
+      (float)(v.x - origin.x),
+      (float)(v.y - origin.y),
+      (float)(v.z - origin.z),
+  };
+}
+
+// catmull-rom spline through 'p1' and 'p2' at 't' in [0, 1], with 'p0' and
+// 'p3' as the neighbouring control points.
+static inline struct vec3d vec3d_catmull_rom(const struct vec3d p0,
+                                             const struct vec3d p1,
+                                             const struct vec3d p2,
+                                             const struct vec3d p3,
+                                             const double t) {
+  const double t2 = t * t, t3 = t2 * t;
+  return (struct vec3d){
+      0.5 * (2 * p1.x + (p2.x - p0.x) * t +
+             (2 * p0.x - 5 * p1.x + 4 * p2.x - p3.x) * t2 +
+             (3 * p1.x - p0.x - 3 * p2.x + p3.x) * t3),
+      0.5 * (2 * p1.y + (p2.y - p0.y) * t +
+             (2 * p0.y - 5 * p1.y + 4 * p2.y - p3.y) * t2 +
+             (3 * p1.y - p0.y - 3 * p2.y + p3.y) * t3),
+      0.5 * (2 * p1.z + (p2.z - p0.z) * t +
+             (2 * p0.z - 5 * p1.z + 4 * p2.z - p3.z) * t2 +
+             (3 * p1.z - p0.z - 3 * p2.z + p3.z) * t3),
+  };
+}
+
 static inline struct quat quat_from_angle_axis(float angle, struct vec3 axis) {
   struct quat ret;
   float s = sinf(angle / 2);
@@ -561,6 +646,88 @@ static inline struct quat quat_conjugate(struct quat q) {
   return (struct quat){-q.x, -q.y, -q.z, q.w};
 }
 
+static inline float quat_dot(struct quat q1, struct quat q2) {
+  return q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w;
+}
+
+static inline struct quat quat_normalized(struct quat q) {
+  const float magnitude = sqrtf(quat_dot(q, q));
+  if (magnitude == 0) {
+    return (struct quat){0, 0, 0, 1};
+  }
+  return (struct quat){q.x / magnitude, q.y / magnitude, q.z / magnitude,
+                       q.w / magnitude};
+}
+
+// normalized linear interpolation along the shorter arc. close enough to
+// slerp for the small steps between neighbouring keys.
+static inline struct quat quat_nlerp(struct quat q1, struct quat q2,
+                                     float t) {
+  const float sign = quat_dot(q1, q2) < 0 ? -1 : 1;
+  return quat_normalized((struct quat){
+      q1.x + (sign * q2.x - q1.x) * t,
+      q1.y + (sign * q2.y - q1.y) * t,
+      q1.z + (sign * q2.z - q1.z) * t,
+      q1.w + (sign * q2.w - q1.w) * t,
+  });
+}
+
+// spherical linear interpolation along the shorter arc, turning at a
+// constant rate. nearly equal rotations use quat_nlerp, which is exact
+// enough there and avoids dividing by a vanishing sine.
+static inline struct quat quat_slerp(struct quat q1, struct quat q2,
+                                     float t) {
+  float cos_angle = quat_dot(q1, q2);
+  if (cos_angle < 0) {
+    q2 = (struct quat){-q2.x, -q2.y, -q2.z, -q2.w};
+    cos_angle = -cos_angle;
+  }
+  if (cos_angle > 0.9995f) {
+    return quat_nlerp(q1, q2, t);
+  }
+  const float angle = acosf(cos_angle);
+  const float sin_angle = sinf(angle);
+  const float w1 = sinf((1 - t) * angle) / sin_angle;
+  const float w2 = sinf(t * angle) / sin_angle;
+  return (struct quat){
+      q1.x * w1 + q2.x * w2,
+      q1.y * w1 + q2.y * w2,
+      q1.z * w1 + q2.z * w2,
+      q1.w * w1 + q2.w * w2,
+  };
+}
+
+// the rotation turning +z towards 'forward' and +y as close to 'up' as it
+// can get. 'forward' and 'up' must not be parallel.
+static inline struct quat quat_look_rotation(struct vec3 forward,
+                                             struct vec3 up) {
+  const struct vec3 f = vec3_normalized(forward);
+  const struct vec3 r = vec3_normalized(vec3_cross(up, f));
+  const struct vec3 u = vec3_cross(f, r);
+
+  // the columns of the rotation matrix are r, u and f.
+  const float trace = r.x + u.y + f.z;
+  struct quat q;
+  if (trace > 0) {
+    const float s = 0.5f / sqrtf(trace + 1);
+    q = (struct quat){(u.z - f.y) * s, (f.x - r.z) * s, (r.y - u.x) * s,
+                      0.25f / s};
+  } else if (r.x > u.y && r.x > f.z) {
+    const float s = 2 * sqrtf(1 + r.x - u.y - f.z);
+    q = (struct quat){0.25f * s, (u.x + r.y) / s, (f.x + r.z) / s,
+                      (u.z - f.y) / s};
+  } else if (u.y > f.z) {
+    const float s = 2 * sqrtf(1 + u.y - r.x - f.z);
+    q = (struct quat){(u.x + r.y) / s, 0.25f * s, (f.y + u.z) / s,
+                      (f.x - r.z) / s};
+  } else {
+    const float s = 2 * sqrtf(1 + f.z - r.x - u.y);
+    q = (struct quat){(f.x + r.z) / s, (f.y + u.z) / s, 0.25f * s,
+                      (r.y - u.x) / s};
+  }
+  return quat_normalized(q);
+}
+
 static inline struct vec3 vec3_rotate(struct vec3 v, struct quat q) {
   struct quat ret = (struct quat){v.x, v.y, v.z, 0.0};
   ret = quat_multiply(quat_multiply(q, ret), quat_conjugate(q));
@@ -644,32 +811,65 @@ static inline void mathf_mat4_identity(float matrix[16]) {
 }
 
 /*Multiplies a 4x4 matrix with another 4x4 matrix*/
+/*'result' may alias 'a' or 'b'*/
 static inline void mathf_mat4_multiply(float *result, const float *a,
                                        const float *b) {
 
+  float product[16];
+
   // row 0
-  result[0] = a[0] * b[0] + a[4] * b[1] + a[8] * b[2] + a[12] * b[3];
-  result[1] = a[0] * b[1] + a[1] * b[5] + a[2] * b[9] + a[3] * b[13];
-  result[2] = a[0] * b[2] + a[1] * b[6] + a[2] * b[10] + a[3] * b[14];
-  result[3] = a[0] * b[3] + a[1] * b[7] + a[2] * b[11] + a[3] * b[15];
+  product[0] = a[0] * b[0] + a[1] * b[4] + a[2] * b[8] + a[3] * b[12];
+  product[1] = a[0] * b[1] + a[1] * b[5] + a[2] * b[9] + a[3] * b[13];
+  product[2] = a[0] * b[2] + a[1] * b[6] + a[2] * b[10] + a[3] * b[14];
+  product[3] = a[0] * b[3] + a[1] * b[7] + a[2] * b[11] + a[3] * b[15];
 
   // row 1
-  result[4] = a[4] * b[0] + a[5] * b[4] + a[6] * b[8] + a[7] * b[12];
-  result[5] = a[4] * b[1] + a[5] * b[5] + a[6] * b[9] + a[7] * b[13];
-  result[6] = a[4] * b[2] + a[5] * b[6] + a[6] * b[10] + a[7] * b[14];
-  result[7] = a[4] * b[3] + a[5] * b[7] + a[6] * b[11] + a[7] * b[15];
+  product[4] = a[4] * b[0] + a[5] * b[4] + a[6] * b[8] + a[7] * b[12];
+  product[5] = a[4] * b[1] + a[5] * b[5] + a[6] * b[9] + a[7] * b[13];
+  product[6] = a[4] * b[2] + a[5] * b[6] + a[6] * b[10] + a[7] * b[14];
+  product[7] = a[4] * b[3] + a[5] * b[7] + a[6] * b[11] + a[7] * b[15];
 
   // row 2
-  result[8] = a[8] * b[0] + a[9] * b[4] + a[10] * b[8] + a[11] * b[12];
-  result[9] = a[8] * b[1] + a[9] * b[5] + a[10] * b[9] + a[11] * b[13];
-  result[10] = a[8] * b[2] + a[9] * b[6] + a[10] * b[10] + a[11] * b[14];
-  result[11] = a[8] * b[3] + a[9] * b[7] + a[10] * b[11] + a[11] * b[15];
+  product[8] = a[8] * b[0] + a[9] * b[4] + a[10] * b[8] + a[11] * b[12];
+  product[9] = a[8] * b[1] + a[9] * b[5] + a[10] * b[9] + a[11] * b[13];
+  product[10] = a[8] * b[2] + a[9] * b[6] + a[10] * b[10] + a[11] * b[14];
+  product[11] = a[8] * b[3] + a[9] * b[7] + a[10] * b[11] + a[11] * b[15];
 
   // row 3
-  result[12] = a[12] * b[0] + a[13] * b[4] + a[14] * b[8] + a[15] * b[12];
-  result[13] = a[12] * b[1] + a[13] * b[5] + a[14] * b[9] + a[15] * b[13];
-  result[14] = a[12] * b[2] + a[13] * b[6] + a[14] * b[10] + a[15] * b[14];
-  result[15] = a[12] * b[3] + a[13] * b[7] + a[14] * b[11] + a[15] * b[15];
+  product[12] = a[12] * b[0] + a[13] * b[4] + a[14] * b[8] + a[15] * b[12];
+  product[13] = a[12] * b[1] + a[13] * b[5] + a[14] * b[9] + a[15] * b[13];
+  product[14] = a[12] * b[2] + a[13] * b[6] + a[14] * b[10] + a[15] * b[14];
+  product[15] = a[12] * b[3] + a[13] * b[7] + a[14] * b[11] + a[15] * b[15];
+
+  for (int i = 0; i < 16; i++) {
+    result[i] = product[i];
+  }
+}
+
+// computes the normal matrix of a 4x4 model matrix, the inverse transpose of
+// its upper 3x3, and stores it inside 'normal_matrix' in the same row layout.
+// for a scale * rotation * translation matrix this is inverse(scale) *
+// rotation. it is built from cofactors, so no full inverse is needed.
+static inline void mathf_mat4_normal_matrix(float normal_matrix[9],
+                                            const float matrix[16]) {
+  const float a = matrix[0], b = matrix[1], c = matrix[2];
+  const float d = matrix[4], e = matrix[5], f = matrix[6];
+  const float g = matrix[8], h = matrix[9], i = matrix[10];
+
+  const float cofactors[9] = {
+      e * i - f * h, f * g - d * i, d * h - e * g,
+      c * h - b * i, a * i - c * g, b * g - a * h,
+      b * f - c * e, c * d - a * f, a * e - b * d,
+  };
+
+  const float determinant =
+      a * cofactors[0] + b * cofactors[1] + c * cofactors[2];
+  const float inverse_determinant =
+      determinant != 0 ? 1.0f / determinant : 1.0f;
+
+  for (int j = 0; j < 9; j++) {
+    normal_matrix[j] = cofactors[j] * inverse_determinant;
+  }
 }
 
 // creates an 4x4 orthographic projection matrix and stores it inside 'matrix'
@@ -704,6 +904,24 @@ static inline void mathf_mat4_perspective(float matrix[16], const float fov,
   matrix[14] = ((2.0 * near * far) / (near - far));
 }
 
+// creates a 4x4 reversed-Z perspective projection matrix with an infinitely
+// distant far plane and stores it inside 'matrix'. depth is 1 at the near
+// plane and approaches 0 at infinity, which pairs with a [0, 1] clip range,
+// a depth clear value of 0 and a GL_GREATER depth test.
+static inline void mathf_mat4_perspective_reversed_infinite(float matrix[16],
+                                                            const float fov,
+                                                            const float aspect,
+                                                            const float near) {
+
+  const float cotan = (1.0 / tanf(fov * 0.5));
+
+  matrix[0] = (cotan / aspect);
+  matrix[5] = cotan;
+  matrix[10] = 0.0f;
+  matrix[11] = 1.0f;
+  matrix[14] = near;
+}
+
 // converts a given 'transform' to a 4x4 view matrix and stores it inside
 // 'matrix'
 static inline void
@@ -725,31 +943,265 @@ mathf_transform_view_matrix(float matrix[16],
   mathf_mat4_multiply(matrix, translation, rotation);
 }
 
+// builds a 4x4 model matrix from the individual components of a transform and
+// stores it inside 'matrix'. this is the expanded form of
+// scale * rotation * translation, so no intermediate matrices are needed.
+static inline void mathf_transform_matrix_components(
+    float matrix[16], const float px, const float py, const float pz,
+    const float qx, const float qy, const float qz, const float qw,
+    const float sx, const float sy, const float sz) {
+
+  const float xx = qx * qx, xy = qx * qy, xz = qx * qz, xw = qx * qw,
+              yy = qy * qy, yz = qy * qz, yw = qy * qw, zz = qz * qz,
+              zw = qz * qw;
+
+  // row 1
+  matrix[0] = sx * (1 - 2 * (yy + zz));
+  matrix[1] = sx * (2 * (xy + zw));
+  matrix[2] = sx * (2 * (xz - yw));
+  matrix[3] = 0;
+
+  // row 2
+  matrix[4] = sy * (2 * (xy - zw));
+  matrix[5] = sy * (1 - 2 * (xx + zz));
+  matrix[6] = sy * (2 * (yz + xw));
+  matrix[7] = 0;
+
+  // row 3
+  matrix[8] = sz * (2 * (xz + yw));
+  matrix[9] = sz * (2 * (yz - xw));
+  matrix[10] = sz * (1 - 2 * (xx + yy));
+  matrix[11] = 0;
+
+  // row 4
+  matrix[12] = px;
+  matrix[13] = py;
+  matrix[14] = pz;
+  matrix[15] = 1;
+}
+
 // converts a given 'transform' to a 4x4 model matrix and stores it inside
 // 'matrix'
 static inline void mathf_transform_matrix(float matrix[16],
                                           const struct transform *transform) {
-  mathf_mat4_identity(matrix);
+  mathf_transform_matrix_components(
+      matrix, transform->position.x, transform->position.y,
+      transform->position.z, transform->rotation.x, transform->rotation.y,
+      transform->rotation.z, transform->rotation.w, transform->scale.x,
+      transform->scale.y, transform->scale.z);
+}
+
+// converts a given double precision 'transform' to a 4x4 model matrix relative
+// to 'origin' and stores it inside 'matrix'
+static inline void mathf_transformd_matrix(float matrix[16],
+                                           const struct transformd *transform,
+                                           const struct vec3d origin) {
+  const struct vec3 position = vec3d_relative(transform->position, origin);
+  mathf_transform_matrix_components(
+      matrix, position.x, position.y, position.z, transform->rotation.x,
+      transform->rotation.y, transform->rotation.z, transform->rotation.w,
+      transform->scale.x, transform->scale.y, transform->scale.z);
+}
+
+static inline struct transformd
+transformd_from_transform(const struct transform transform) {
+  return (struct transformd){
+      .position = vec3d_from_vec3(transform.position),
+      .rotation = transform.rotation,
+      .scale = transform.scale,
+  };
+}
 
-  {
-    float scale[16];
-    mathf_mat4_identity(scale);
-    scale[0] = transform->scale.x;
-    scale[5] = transform->scale.y;
-    scale[10] = transform->scale.z;
+// the transform 't' of the way from 'a' to 'b', for drawing between two
+// simulation steps.
+static inline struct transformd transformd_lerp(const struct transformd a,
+                                                const struct transformd b,
+                                                const float t) {
+  return (struct transformd){
+      .position = vec3d_lerp(a.position, b.position, t),
+      .rotation = quat_slerp(a.rotation, b.rotation, t),
+      .scale = vec3_lerp(a.scale, b.scale, t),
+  };
+}
+
+// a set of transforms stored as a structure of arrays. each component lives in
+// its own contiguous array so batch operations can process many objects at
+// once.
+struct transform_array {
+  float *position_x, *position_y, *position_z;
+  float *rotation_x, *rotation_y, *rotation_z, *rotation_w;
+  float *scale_x, *scale_y, *scale_z;
+  unsigned int count, capacity;
+};
 
-    float translation[16];
-    mathf_mat4_identity(translation);
-    translation[12] = transform->position.x;
-    translation[13] = transform->position.y;
-    translation[14] = transform->position.z;
+// converts 'count' transforms from 'transforms' starting at 'first' into
+// packed 4x4 model matrices. matrix i is stored at 'matrices' + i * 16, which
+// may point directly into a mapped GPU buffer.
+static inline void
+mathf_transform_matrix_batch(float *restrict matrices,
+                             const struct transform_array *transforms,
+                             const unsigned int first,
+                             const unsigned int count) {
+
+  const float *restrict px = transforms->position_x + first;
+  const float *restrict py = transforms->position_y + first;
+  const float *restrict pz = transforms->position_z + first;
+  const float *restrict qx = transforms->rotation_x + first;
+  const float *restrict qy = transforms->rotation_y + first;
+  const float *restrict qz = transforms->rotation_z + first;
+  const float *restrict qw = transforms->rotation_w + first;
+  const float *restrict sx = transforms->scale_x + first;
+  const float *restrict sy = transforms->scale_y + first;
+  const float *restrict sz = transforms->scale_z + first;
+
+  for (unsigned int i = 0; i < count; i++) {
+    mathf_transform_matrix_components(matrices + i * 16, px[i], py[i], pz[i],
+                                      qx[i], qy[i], qz[i], qw[i], sx[i], sy[i],
+                                      sz[i]);
+  }
+}
 
-    float rotation[16] = {0};
-    quat_to_mat4(transform[0].rotation, rotation);
+// six clipping planes of a view frustum in the order left, right, bottom,
+// top, near, far. each plane stores its normal in xyz and its distance in w;
+// a point p is inside a plane when dot(normal, p) + w >= 0.
+struct frustum {
+  struct vec4 planes[6];
+};
+
+// extracts the frustum planes from a combined view projection 'matrix'.
+// 'zero_to_one_depth' selects the [0, 1] clip range used with reversed-Z, in
+// which case the near and far planes swap places; otherwise the OpenGL
+// [-1, 1] range is assumed. planes are normalized so
+// the culling tests below can compare distances against radii directly.
+static inline void mathf_frustum_from_matrix(struct frustum *frustum,
+                                             const float matrix[16],
+                                             const int zero_to_one_depth) {
+  // clip = vec4(p, 1) * matrix, so each clip component is a matrix column.
+  struct vec4 column[4];
+  for (int i = 0; i < 4; i++) {
+    column[i] = (struct vec4){matrix[i], matrix[4 + i], matrix[8 + i],
+                              matrix[12 + i]};
+  }
+
+  const float sign[6] = {1, -1, 1, -1, 1, -1};
+  const int axis[6] = {0, 0, 1, 1, 2, 2};
+  for (int i = 0; i < 6; i++) {
+    const struct vec4 c = column[axis[i]];
+    const float w = (i == 4 && zero_to_one_depth) ? 0 : 1;
+    frustum->planes[i] = (struct vec4){
+        column[3].x * w + c.x * sign[i],
+        column[3].y * w + c.y * sign[i],
+        column[3].z * w + c.z * sign[i],
+        column[3].w * w + c.w * sign[i],
+    };
+
+    struct vec4 *plane = &frustum->planes[i];
+    const float length =
+        sqrtf(plane->x * plane->x + plane->y * plane->y + plane->z * plane->z);
+    // an infinite far plane has no normal; it is left as an always-pass plane.
+    if (length > 0) {
+      plane->x /= length;
+      plane->y /= length;
+      plane->z /= length;
+      plane->w /= length;
+    }
+  }
+}
+
+// tests 'count' bounding spheres, stored as separate coordinate and radius
+// arrays, against 'frustum'. bit i of 'visibility' (32 objects per word) is
+// set when sphere i intersects the frustum. objects are processed in blocks
+// of 32 so the per-object tests vectorize before being packed into bits.
+static inline void mathf_frustum_cull_spheres(
+    const struct frustum *frustum, const float *restrict x,
+    const float *restrict y, const float *restrict z,
+    const float *restrict radius, const unsigned int count,
+    uint32_t *restrict visibility) {
+
+  const struct vec4 *p = frustum->planes;
+
+  for (unsigned int block = 0; block < count; block += 32) {
+    const unsigned int block_count = count - block < 32 ? count - block : 32;
+    uint8_t inside[32];
+
+    for (unsigned int j = 0; j < block_count; j++) {
+      const unsigned int i = block + j;
+      const float r = -radius[i];
+      inside[j] = (p[0].x * x[i] + p[0].y * y[i] + p[0].z * z[i] + p[0].w >=
+                   r) &
+                  (p[1].x * x[i] + p[1].y * y[i] + p[1].z * z[i] + p[1].w >=
+                   r) &
+                  (p[2].x * x[i] + p[2].y * y[i] + p[2].z * z[i] + p[2].w >=
+                   r) &
+                  (p[3].x * x[i] + p[3].y * y[i] + p[3].z * z[i] + p[3].w >=
+                   r) &
+                  (p[4].x * x[i] + p[4].y * y[i] + p[4].z * z[i] + p[4].w >=
+                   r) &
+                  (p[5].x * x[i] + p[5].y * y[i] + p[5].z * z[i] + p[5].w >= r);
+    }
+
+    uint32_t bits = 0;
+    for (unsigned int j = 0; j < block_count; j++) {
+      bits |= (uint32_t)inside[j] << j;
+    }
+    visibility[block / 32] = bits;
+  }
+}
+
+// tests 'count' axis aligned bounding boxes, given as centers and half
+// extents in separate arrays, against 'frustum'. the results are packed into
+// 'visibility' in the same way as mathf_frustum_cull_spheres.
+static inline void mathf_frustum_cull_aabbs(
+    const struct frustum *frustum, const float *restrict center_x,
+    const float *restrict center_y, const float *restrict center_z,
+    const float *restrict extent_x, const float *restrict extent_y,
+    const float *restrict extent_z, const unsigned int count,
+    uint32_t *restrict visibility) {
+
+  const struct vec4 *p = frustum->planes;
+
+  for (unsigned int block = 0; block < count; block += 32) {
+    const unsigned int block_count = count - block < 32 ? count - block : 32;
+    uint8_t inside[32];
+
+    for (unsigned int j = 0; j < block_count; j++) {
+      const unsigned int i = block + j;
+      uint8_t visible = 1;
+      for (int k = 0; k < 6; k++) {
+        // distance of the box corner furthest along the plane normal.
+        const float distance = p[k].x * center_x[i] + p[k].y * center_y[i] +
+                               p[k].z * center_z[i] + p[k].w +
+                               fabsf(p[k].x) * extent_x[i] +
+                               fabsf(p[k].y) * extent_y[i] +
+                               fabsf(p[k].z) * extent_z[i];
+        visible &= distance >= 0;
+      }
+      inside[j] = visible;
+    }
+
+    uint32_t bits = 0;
+    for (unsigned int j = 0; j < block_count; j++) {
+      bits |= (uint32_t)inside[j] << j;
+    }
+    visibility[block / 32] = bits;
+  }
+}
 
-    mathf_mat4_multiply(matrix, scale, rotation);
-    mathf_mat4_multiply(matrix, matrix, translation);
+// writes the index of every set bit in 'visibility' to 'indices' and returns
+// how many were written. 'indices' must have room for 'count' entries.
+static inline unsigned int
+mathf_visibility_compact(const uint32_t *visibility, const unsigned int count,
+                         unsigned int *indices) {
+  unsigned int visible_count = 0;
+  for (unsigned int block = 0; block < count; block += 32) {
+    uint32_t bits = visibility[block / 32];
+    while (bits) {
+      const unsigned int bit = __builtin_ctz(bits);
+      indices[visible_count++] = block + bit;
+      bits &= bits - 1;
+    }
   }
+  return visible_count;
 }
 
 #endif // MATHF_H
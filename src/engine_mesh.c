@@ -126,10 +126,13 @@ struct mesh engine_mesh_quad_alloc(void) {
   return mesh;
 }
 
-struct mesh engine_mesh_planet_alloc(const unsigned int subdivisions,
-                                     const struct vec3 noise_scale,
-                                     const struct vec3 noise_offset,
-                                     const float amplitude) {
+// generates a noise displaced icosphere. the lists are allocated here and
+// owned by the caller.
+void engine_mesh_planet_generate(const unsigned int subdivisions,
+                                 const struct vec3 noise_scale,
+                                 const struct vec3 noise_offset,
+                                 const float amplitude, list_vec3 *vertices,
+                                 list_vec3 *normals, list_GLuint *indices) {
 
   list_GLuint indices_initial = NULL;
   list_vec3 vertices_initial = NULL;
@@ -268,6 +271,39 @@ struct mesh engine_mesh_planet_alloc(const unsigned int subdivisions,
   }
 #endif
 
+  *vertices = vertices_initial;
+  *normals = normals_initial;
+  *indices = indices_initial;
+}
+
+struct mesh engine_mesh_planet_alloc(const unsigned int subdivisions,
+                                     const struct vec3 noise_scale,
+                                     const struct vec3 noise_offset,
+                                     const float amplitude) {
+  list_vec3 vertices = NULL;
+  list_vec3 normals = NULL;
+  list_GLuint indices = NULL;
+  engine_mesh_planet_generate(subdivisions, noise_scale, noise_offset,
+                              amplitude, &vertices, &normals, &indices);
+
+  struct mesh mesh =
+      engine_mesh_upload(vertices, normals, list_vec3_count(vertices), indices,
+                         list_GLuint_count(indices));
+
+  list_GLuint_free(indices);
+  list_vec3_free(vertices);
+  list_vec3_free(normals);
+
+  return mesh;
+}
+
+// creates a mesh with its own vertex array and buffers. 'indices' may be NULL
+// for a non-indexed mesh.
+struct mesh engine_mesh_upload(const struct vec3 *vertices,
+                               const struct vec3 *normals,
+                               const GLuint vertices_count,
+                               const GLuint *indices,
+                               const GLuint indices_count) {
   GLuint VAO = 0;
   GLuint vertices_VBO = 0;
   GLuint normals_VBO = 0;
@@ -282,25 +318,24 @@ struct mesh engine_mesh_planet_alloc(const unsigned int subdivisions,
 
   // positions
   glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
-  glBufferData(GL_ARRAY_BUFFER,
-               list_vec3_count(vertices_initial) * sizeof(*vertices_initial),
-               vertices_initial, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, vertices_count * sizeof(*vertices), vertices,
+               GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
   glEnableVertexAttribArray(0);
 
   GLuint EBO = 0;
-  glGenBuffers(1, &EBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-               sizeof(*indices_initial) * list_GLuint_count(indices_initial),
-               indices_initial, GL_STATIC_DRAW);
+  if (indices != NULL) {
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(*indices) * indices_count,
+                 indices, GL_STATIC_DRAW);
+  }
 
   // normals
   glBindBuffer(GL_ARRAY_BUFFER, normals_VBO);
-  glBufferData(GL_ARRAY_BUFFER,
-               list_vec3_count(normals_initial) * sizeof(*normals_initial),
-               normals_initial, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, vertices_count * sizeof(*normals), normals,
+               GL_STATIC_DRAW);
 
   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
   glEnableVertexAttribArray(1);
@@ -313,18 +348,18 @@ struct mesh engine_mesh_planet_alloc(const unsigned int subdivisions,
   mesh.normals_VBO = normals_VBO;
   mesh.texcoords_VBO = texcoords_VBO;
   mesh.EBO = EBO;
-  mesh.vertices_count = list_vec3_count(vertices_initial);
-  mesh.indices_count = list_GLuint_count(indices_initial);
-  mesh.use_indexed_draw = true;
-
-  list_GLuint_free(indices_initial);
-  list_vec3_free(vertices_initial);
-  list_vec3_free(normals_initial);
+  mesh.vertices_count = vertices_count;
+  mesh.indices_count = indices_count;
+  mesh.use_indexed_draw = indices != NULL;
 
   return mesh;
 }
 
 void engine_mesh_free(struct mesh *mesh) {
+  if (mesh->is_pooled) {
+    return;
+  }
+
   if (mesh->VAO) {
     glDeleteVertexArrays(1, &mesh->VAO);
   } else {
@@ -0,0 +1,134 @@
+#include "engine.h"
+
+// Static meshes sub-allocated from one set of large buffers. Every pooled
+// mesh shares the vertex array, so the render queue can draw all of them
+// that use the same program and texture with a single
+// glMultiDrawElementsIndirect call. Space is handed out front to back and is
+// only reclaimed when the whole pool is freed.
+
+static struct {
+  GLuint VAO;
+  GLuint vertices_VBO;
+  GLuint normals_VBO;
+  GLuint EBO;
+  GLuint vertices_capacity;
+  GLuint indices_capacity;
+  GLuint vertices_count;
+  GLuint indices_count;
+} engine_mesh_pool = {0};
+
+void engine_mesh_pool_alloc(const GLuint vertices_capacity,
+                            const GLuint indices_capacity) {
+  glGenVertexArrays(1, &engine_mesh_pool.VAO);
+  glBindVertexArray(engine_mesh_pool.VAO);
+
+  glGenBuffers(1, &engine_mesh_pool.vertices_VBO);
+  glGenBuffers(1, &engine_mesh_pool.normals_VBO);
+  glGenBuffers(1, &engine_mesh_pool.EBO);
+
+  // positions
+  glBindBuffer(GL_ARRAY_BUFFER, engine_mesh_pool.vertices_VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices_capacity * sizeof(struct vec3), NULL,
+               GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
+  glEnableVertexAttribArray(0);
+
+  // normals
+  glBindBuffer(GL_ARRAY_BUFFER, engine_mesh_pool.normals_VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices_capacity * sizeof(struct vec3), NULL,
+               GL_STATIC_DRAW);
+
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
+  glEnableVertexAttribArray(1);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, engine_mesh_pool.EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_capacity * sizeof(GLuint),
+               NULL, GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+
+  engine_mesh_pool.vertices_capacity = vertices_capacity;
+  engine_mesh_pool.indices_capacity = indices_capacity;
+  engine_mesh_pool.vertices_count = 0;
+  engine_mesh_pool.indices_count = 0;
+}
+
+void engine_mesh_pool_free(void) {
+  glDeleteVertexArrays(1, &engine_mesh_pool.VAO);
+  glDeleteBuffers(1, &engine_mesh_pool.vertices_VBO);
+  glDeleteBuffers(1, &engine_mesh_pool.normals_VBO);
+  glDeleteBuffers(1, &engine_mesh_pool.EBO);
+  engine_mesh_pool.VAO = 0;
+  engine_mesh_pool.vertices_capacity = engine_mesh_pool.vertices_count = 0;
+  engine_mesh_pool.indices_capacity = engine_mesh_pool.indices_count = 0;
+}
+
+// copies a mesh into the pool. non-indexed meshes get sequential indices,
+// since indirect draws are always indexed. if the pool is missing or full
+// the mesh gets its own buffers instead.
+struct mesh engine_mesh_pool_add(const struct vec3 *vertices,
+                                 const struct vec3 *normals,
+                                 const GLuint vertices_count,
+                                 const GLuint *indices,
+                                 const GLuint indices_count) {
+  const GLuint pooled_indices_count =
+      indices != NULL ? indices_count : vertices_count;
+
+  if (engine_mesh_pool.VAO == 0 ||
+      engine_mesh_pool.vertices_count + vertices_count >
+          engine_mesh_pool.vertices_capacity ||
+      engine_mesh_pool.indices_count + pooled_indices_count >
+          engine_mesh_pool.indices_capacity) {
+    engine_warn("mesh pool cannot fit %u vertices, using separate buffers",
+                vertices_count);
+    return engine_mesh_upload(vertices, normals, vertices_count, indices,
+                              indices_count);
+  }
+
+  GLuint *sequential_indices = NULL;
+  if (indices == NULL) {
+    sequential_indices = malloc(vertices_count * sizeof(GLuint));
+    for (GLuint i = 0; i < vertices_count; i++) {
+      sequential_indices[i] = i;
+    }
+    indices = sequential_indices;
+  }
+
+  const GLuint base_vertex = engine_mesh_pool.vertices_count;
+  const GLuint first_index = engine_mesh_pool.indices_count;
+
+  glBindBuffer(GL_ARRAY_BUFFER, engine_mesh_pool.vertices_VBO);
+  glBufferSubData(GL_ARRAY_BUFFER, base_vertex * sizeof(*vertices),
+                  vertices_count * sizeof(*vertices), vertices);
+
+  glBindBuffer(GL_ARRAY_BUFFER, engine_mesh_pool.normals_VBO);
+  glBufferSubData(GL_ARRAY_BUFFER, base_vertex * sizeof(*normals),
+                  vertices_count * sizeof(*normals), normals);
+
+  // the element buffer binding is vertex array state, so bind it through
+  // the pool's vertex array.
+  glBindVertexArray(engine_mesh_pool.VAO);
+  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, first_index * sizeof(*indices),
+                  pooled_indices_count * sizeof(*indices), indices);
+  glBindVertexArray(0);
+
+  free(sequential_indices);
+
+  engine_mesh_pool.vertices_count += vertices_count;
+  engine_mesh_pool.indices_count += pooled_indices_count;
+
+  struct mesh mesh = {0};
+  mesh.VAO = engine_mesh_pool.VAO;
+  mesh.vertices_VBO = engine_mesh_pool.vertices_VBO;
+  mesh.normals_VBO = engine_mesh_pool.normals_VBO;
+  mesh.EBO = engine_mesh_pool.EBO;
+  mesh.vertices_count = vertices_count;
+  mesh.indices_count = pooled_indices_count;
+  mesh.first_index = first_index;
+  mesh.base_vertex = base_vertex;
+  mesh.use_indexed_draw = true;
+  mesh.is_pooled = true;
+
+  return mesh;
+}
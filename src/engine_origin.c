@@ -0,0 +1,191 @@
+#include "engine.h"
+#include <time.h>
+
+// Floating origin for float-only scenes. When the camera drifts too far from
+// the origin, the whole scene is shifted back in one batched pass so float
+// positions near the camera keep their precision.
+
+#define ENGINE_ORIGIN_COST_SMOOTHING (0.25)
+
+typedef struct transform *transform_ptr;
+typedef struct transform_array *transform_array_ptr;
+
+struct engine_origin_listener {
+  engine_origin_rebase_fn callback;
+  void *user_data;
+};
+typedef struct engine_origin_listener engine_origin_listener;
+
+DECLARE_AND_DEFINE_LIST(transform_ptr)
+DECLARE_AND_DEFINE_LIST(transform_array_ptr)
+DECLARE_AND_DEFINE_LIST(engine_origin_listener)
+
+static struct {
+  list_transform_ptr transforms;
+  list_transform_array_ptr transform_arrays;
+  list_engine_origin_listener listeners;
+  float threshold;
+  double cost_per_transform;
+  struct vec3d offset;
+  struct engine_origin_stats stats;
+} engine_origin = {
+    .threshold = ENGINE_ORIGIN_DEFAULT_THRESHOLD,
+};
+
+static double engine_origin_time(void) {
+  struct timespec spec;
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+  return spec.tv_sec + spec.tv_nsec * 1e-9;
+}
+
+static void engine_origin_lists_alloc(void) {
+  if (engine_origin.transforms == NULL) {
+    engine_origin.transforms = list_transform_ptr_alloc();
+    engine_origin.transform_arrays = list_transform_array_ptr_alloc();
+    engine_origin.listeners = list_engine_origin_listener_alloc();
+  }
+}
+
+void engine_origin_register(struct transform *transform) {
+  engine_origin_lists_alloc();
+  list_transform_ptr_add(&engine_origin.transforms, transform);
+}
+
+void engine_origin_unregister(struct transform *transform) {
+  if (engine_origin.transforms == NULL) {
+    return;
+  }
+  for (list_size i = 0; i < list_transform_ptr_count(engine_origin.transforms);
+       i++) {
+    if (engine_origin.transforms[i] == transform) {
+      list_transform_ptr_remove_at(engine_origin.transforms, i);
+      return;
+    }
+  }
+}
+
+void engine_origin_register_array(struct transform_array *transforms) {
+  engine_origin_lists_alloc();
+  list_transform_array_ptr_add(&engine_origin.transform_arrays, transforms);
+}
+
+void engine_origin_unregister_array(struct transform_array *transforms) {
+  if (engine_origin.transform_arrays == NULL) {
+    return;
+  }
+  for (list_size i = 0;
+       i < list_transform_array_ptr_count(engine_origin.transform_arrays);
+       i++) {
+    if (engine_origin.transform_arrays[i] == transforms) {
+      list_transform_array_ptr_remove_at(engine_origin.transform_arrays, i);
+      return;
+    }
+  }
+}
+
+void engine_origin_register_callback(engine_origin_rebase_fn callback,
+                                     void *user_data) {
+  engine_origin_lists_alloc();
+  list_engine_origin_listener_add(
+      &engine_origin.listeners,
+      (engine_origin_listener){.callback = callback, .user_data = user_data});
+}
+
+void engine_origin_set_threshold(const float threshold) {
+  engine_origin.threshold = threshold;
+}
+
+struct vec3d engine_origin_offset(void) { return engine_origin.offset; }
+
+struct engine_origin_stats engine_origin_stats_get(void) {
+  return engine_origin.stats;
+}
+
+static unsigned int engine_origin_transform_count(void) {
+  unsigned int count = list_transform_ptr_count(engine_origin.transforms);
+  for (list_size i = 0;
+       i < list_transform_array_ptr_count(engine_origin.transform_arrays);
+       i++) {
+    count += engine_origin.transform_arrays[i]->count;
+  }
+  return count;
+}
+
+static void engine_origin_rebase(struct camera *camera,
+                                 const struct vec3 shift) {
+  const double start = engine_origin_time();
+
+  for (list_size i = 0; i < list_transform_ptr_count(engine_origin.transforms);
+       i++) {
+    vec3_sub(&engine_origin.transforms[i]->position, shift);
+  }
+
+  for (list_size i = 0;
+       i < list_transform_array_ptr_count(engine_origin.transform_arrays);
+       i++) {
+    struct transform_array *transforms = engine_origin.transform_arrays[i];
+    float *restrict x = transforms->position_x;
+    float *restrict y = transforms->position_y;
+    float *restrict z = transforms->position_z;
+    for (unsigned int j = 0; j < transforms->count; j++) {
+      x[j] -= shift.x;
+      y[j] -= shift.y;
+      z[j] -= shift.z;
+    }
+  }
+
+  for (list_size i = 0;
+       i < list_engine_origin_listener_count(engine_origin.listeners); i++) {
+    engine_origin.listeners[i].callback(shift,
+                                        engine_origin.listeners[i].user_data);
+  }
+
+  vec3_sub(&camera->transform.position, shift);
+  vec3d_add(&engine_origin.offset, vec3d_from_vec3(shift));
+
+  const double cost = engine_origin_time() - start;
+  const unsigned int count = engine_origin_transform_count();
+  if (count > 0) {
+    const double cost_per_transform = cost / count;
+    engine_origin.cost_per_transform =
+        engine_origin.stats.rebase_count == 0
+            ? cost_per_transform
+            : engine_origin.cost_per_transform +
+                  (cost_per_transform - engine_origin.cost_per_transform) *
+                      ENGINE_ORIGIN_COST_SMOOTHING;
+  }
+
+  engine_origin.stats.rebase_count++;
+  engine_origin.stats.last_cost = cost;
+  engine_origin.stats.total_cost += cost;
+  if (cost > engine_origin.stats.max_cost) {
+    engine_origin.stats.max_cost = cost;
+  }
+}
+
+// rebases the scene around the camera once it drifts past the threshold.
+// from half the threshold onwards the rebase is scheduled into the first frame
+// whose spare time ('frame_slack', in seconds) covers the cost measured on
+// previous rebases, so it is absorbed by a frame that would otherwise idle.
+// once the full threshold is reached the rebase always happens. returns true
+// if the scene was rebased.
+bool engine_origin_update(struct camera *camera, const double frame_slack) {
+  engine_origin_lists_alloc();
+
+  const struct vec3 shift = camera->transform.position;
+  const float distance = vec3_magnitude(shift);
+  if (distance < engine_origin.threshold * 0.5) {
+    return false;
+  }
+
+  const double estimated_cost =
+      engine_origin.cost_per_transform * engine_origin_transform_count();
+
+  if (distance < engine_origin.threshold && estimated_cost > frame_slack) {
+    engine_origin.stats.deferred_count++;
+    return false;
+  }
+
+  engine_origin_rebase(camera, shift);
+  return true;
+}
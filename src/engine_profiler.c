@@ -0,0 +1,237 @@
+#include "engine.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+// Hierarchical CPU profiler. engine_profiler_begin/end write timestamped
+// markers into a ring buffer owned by the calling thread, so recording never
+// takes a lock; a thread's buffer is allocated on its first marker and
+// pushed onto a lock-free list. Markers are only written while a capture is
+// running, so instrumented code costs one atomic load otherwise. When the
+// captured range of frames ends, every thread's markers from that range are
+// written as Chrome trace event JSON, which chrome://tracing and Perfetto
+// both open.
+
+#define ENGINE_PROFILER_EVENTS_MAX (1 << 16 /* per thread */)
+
+struct engine_profiler_event {
+  uint64_t time;
+  // NULL for the end of the innermost open scope.
+  const char *name;
+};
+
+struct engine_profiler_thread {
+  struct engine_profiler_event events[ENGINE_PROFILER_EVENTS_MAX];
+  // events written so far. only the owning thread stores it.
+  atomic_uint_fast64_t events_count;
+  // events_count when the current capture started.
+  uint_fast64_t capture_start;
+  unsigned int id;
+  const char *name;
+  struct engine_profiler_thread *next;
+};
+
+static struct {
+  _Atomic(struct engine_profiler_thread *) threads;
+  atomic_uint threads_count;
+  atomic_bool is_recording;
+  unsigned long frame;
+  unsigned long capture_first_frame;
+  unsigned long capture_last_frame;
+  const char *capture_path;
+  uint64_t epoch;
+} engine_profiler = {0};
+
+static _Thread_local struct engine_profiler_thread *engine_profiler_thread =
+    NULL;
+// kept apart from the buffer, so naming a thread does not allocate one.
+static _Thread_local const char *engine_profiler_thread_label = NULL;
+
+// nanoseconds on a clock that is neither adjusted by NTP nor stepped.
+static uint64_t engine_profiler_time(void) {
+  struct timespec spec;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+#endif
+  return (uint64_t)spec.tv_sec * 1000000000u + spec.tv_nsec;
+}
+
+static struct engine_profiler_thread *engine_profiler_thread_get(void) {
+  if (engine_profiler_thread != NULL) {
+    return engine_profiler_thread;
+  }
+
+  struct engine_profiler_thread *thread = calloc(1, sizeof(*thread));
+  if (thread == NULL) {
+    return NULL;
+  }
+  thread->id = atomic_fetch_add(&engine_profiler.threads_count, 1) + 1;
+  thread->name = engine_profiler_thread_label;
+  thread->next = atomic_load(&engine_profiler.threads);
+  while (!atomic_compare_exchange_weak(&engine_profiler.threads,
+                                       &thread->next, thread)) {
+  }
+  engine_profiler_thread = thread;
+  return thread;
+}
+
+static void engine_profiler_record(const char *name) {
+  struct engine_profiler_thread *thread = engine_profiler_thread_get();
+  if (thread == NULL) {
+    return;
+  }
+  const uint_fast64_t count =
+      atomic_load_explicit(&thread->events_count, memory_order_relaxed);
+  thread->events[count % ENGINE_PROFILER_EVENTS_MAX] =
+      (struct engine_profiler_event){
+          .time = engine_profiler_time(),
+          .name = name,
+      };
+  // publish the event only once it is written.
+  atomic_store_explicit(&thread->events_count, count + 1,
+                        memory_order_release);
+}
+
+// opens a scope named 'name' on the calling thread. 'name' must outlive the
+// capture, which string literals do.
+void engine_profiler_begin(const char *name) {
+  if (atomic_load_explicit(&engine_profiler.is_recording,
+                           memory_order_relaxed)) {
+    engine_profiler_record(name);
+  }
+}
+
+void engine_profiler_end(void) {
+  if (atomic_load_explicit(&engine_profiler.is_recording,
+                           memory_order_relaxed)) {
+    engine_profiler_record(NULL);
+  }
+}
+
+// names the calling thread in captured traces.
+void engine_profiler_thread_name(const char *name) {
+  engine_profiler_thread_label = name;
+  if (engine_profiler_thread != NULL) {
+    engine_profiler_thread->name = name;
+  }
+}
+
+static void engine_profiler_json_string(FILE *file, const char *string) {
+  fputc('"', file);
+  for (; *string != '\0'; string++) {
+    if (*string == '"' || *string == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*string, file);
+  }
+  fputc('"', file);
+}
+
+static bool engine_profiler_write(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    engine_error("failed to open trace file '%s'", path);
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool is_first = true;
+  unsigned long events_count = 0, lost_count = 0;
+
+  for (struct engine_profiler_thread *thread =
+           atomic_load(&engine_profiler.threads);
+       thread != NULL; thread = thread->next) {
+    const uint_fast64_t end =
+        atomic_load_explicit(&thread->events_count, memory_order_acquire);
+    uint_fast64_t begin = thread->capture_start;
+    // markers that were overwritten before the capture ended are lost.
+    if (end - begin > ENGINE_PROFILER_EVENTS_MAX) {
+      lost_count += end - begin - ENGINE_PROFILER_EVENTS_MAX;
+      begin = end - ENGINE_PROFILER_EVENTS_MAX;
+    }
+
+    if (thread->name != NULL) {
+      fprintf(file,
+              "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":",
+              is_first ? "" : ",\n", thread->id);
+      engine_profiler_json_string(file, thread->name);
+      fprintf(file, "}}");
+      is_first = false;
+    }
+
+    for (uint_fast64_t i = begin; i < end; i++) {
+      const struct engine_profiler_event *event =
+          &thread->events[i % ENGINE_PROFILER_EVENTS_MAX];
+      const double timestamp =
+          (double)(event->time - engine_profiler.epoch) / 1e3; // microseconds
+      fprintf(file, "%s{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+              is_first ? "" : ",\n", event->name != NULL ? "B" : "E",
+              thread->id, timestamp);
+      if (event->name != NULL) {
+        fprintf(file, ",\"name\":");
+        engine_profiler_json_string(file, event->name);
+      }
+      fputc('}', file);
+      is_first = false;
+      events_count++;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  const bool is_written = fclose(file) == 0;
+
+  if (lost_count > 0) {
+    engine_warn("%lu profiler markers were overwritten during the capture",
+                lost_count);
+  }
+  engine_log("wrote %lu profiler markers of frames %lu to %lu to '%s'",
+             events_count, engine_profiler.capture_first_frame,
+             engine_profiler.capture_last_frame, path);
+  return is_written;
+}
+
+// records 'frames_count' frames, starting with frame 'first_frame', and
+// writes them to 'path' as a Chrome trace once the last one has ended.
+// a 'first_frame' that has already begun starts with the next frame.
+// returns false if another capture is still pending.
+bool engine_profiler_capture(const unsigned long first_frame,
+                             const unsigned long frames_count,
+                             const char *path) {
+  if (engine_profiler.capture_path != NULL || frames_count == 0) {
+    return false;
+  }
+  engine_profiler.capture_first_frame =
+      first_frame > engine_profiler.frame ? first_frame
+                                          : engine_profiler.frame + 1;
+  engine_profiler.capture_last_frame =
+      engine_profiler.capture_first_frame + frames_count - 1;
+  engine_profiler.capture_path = path;
+  return true;
+}
+
+unsigned long engine_profiler_frame(void) { return engine_profiler.frame; }
+
+// marks a frame boundary. call on the main thread, between frames.
+void engine_profiler_frame_begin(void) {
+  engine_profiler.frame++;
+  if (engine_profiler.capture_path == NULL) {
+    return;
+  }
+
+  if (engine_profiler.frame == engine_profiler.capture_first_frame) {
+    for (struct engine_profiler_thread *thread =
+             atomic_load(&engine_profiler.threads);
+         thread != NULL; thread = thread->next) {
+      thread->capture_start = atomic_load(&thread->events_count);
+    }
+    engine_profiler.epoch = engine_profiler_time();
+    atomic_store(&engine_profiler.is_recording, true);
+  } else if (engine_profiler.frame > engine_profiler.capture_last_frame) {
+    atomic_store(&engine_profiler.is_recording, false);
+    engine_profiler_write(engine_profiler.capture_path);
+    engine_profiler.capture_path = NULL;
+  }
+}
@@ -0,0 +1,530 @@
+#include "engine.h"
+#include <stddef.h>
+#include <string.h>
+
+// Draws are collected during the frame, sorted by a packed 64-bit key and
+// submitted in one loop that skips any GL state change that is already in
+// effect. Consecutive items that share mesh, program and texture are merged
+// into a single instanced draw; their model matrices are streamed into a
+// per-instance vertex attribute along with their normal matrices. When the context has
+// glMultiDrawElementsIndirect, neighbouring batches of pooled meshes that
+// share program and texture are issued together from an indirect buffer.
+//
+// key layout, most significant bits first:
+//   opaque:      pass (4) | program (12) | texture (12) | mesh (12) | depth (24)
+//   transparent: pass (4) | inverted depth (24) | program (12) | texture (12)
+//                | mesh (12)
+// opaque draws are grouped by state and drawn front to back within a group;
+// transparent draws are drawn back to front.
+
+struct render_item {
+  uint64_t key;
+  const struct mesh *mesh;
+  struct shader *shader;
+  GLuint texture;
+  // GPU profiler scope the draw is timed under. may be NULL.
+  const char *scope;
+  GLfloat transform_matrix[16];
+};
+typedef struct render_item render_item;
+
+// per-instance vertex data, read by the vertex shader as in_transform_matrix
+// and in_normal_matrix.
+struct render_instance {
+  GLfloat transform_matrix[16];
+  GLfloat normal_matrix[9];
+};
+
+DECLARE_AND_DEFINE_LIST(render_item)
+
+// a run of queued items drawn with one instanced draw.
+struct render_batch {
+  list_size first, count;
+};
+typedef struct render_batch render_batch;
+
+DECLARE_AND_DEFINE_LIST(render_batch)
+
+// layout defined by glMultiDrawElementsIndirect.
+struct draw_elements_command {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+typedef struct draw_elements_command draw_elements_command;
+
+DECLARE_AND_DEFINE_LIST(draw_elements_command)
+
+// initial per-frame sizes of the stream buffers, they grow as needed.
+#define ENGINE_RENDER_INSTANCES_SIZE (1024 * sizeof(struct render_instance))
+#define ENGINE_RENDER_COMMANDS_SIZE (256 * sizeof(draw_elements_command))
+
+static struct {
+  list_render_item items;
+  list_render_batch batches;
+  list_draw_elements_command commands;
+  struct engine_stream_buffer instance_stream;
+  struct engine_stream_buffer command_stream;
+  GLintptr instance_offset;
+  GLintptr command_offset;
+  const char *scope;
+  bool is_scoped;
+  struct engine_render_stats stats;
+} engine_render_queue = {0};
+
+static const char *engine_render_pass_names[] = {
+    [ENGINE_RENDER_PASS_OPAQUE] = "opaque",
+    [ENGINE_RENDER_PASS_TRANSPARENT] = "transparent",
+};
+
+static uint64_t engine_render_key(const enum engine_render_pass pass,
+                                  const GLuint program, const GLuint texture,
+                                  const GLuint VAO, const float depth) {
+  // the bit pattern of a non-negative float increases with its value, so its
+  // top 24 bits are a cheap monotonic depth key.
+  uint32_t depth_bits;
+  const float positive_depth = depth > 0 ? depth : 0;
+  memcpy(&depth_bits, &positive_depth, sizeof(depth_bits));
+  uint64_t depth_key = depth_bits >> 8;
+
+  const uint64_t state_key = ((uint64_t)(program & 0xfff) << 24) |
+                             ((uint64_t)(texture & 0xfff) << 12) |
+                             (uint64_t)(VAO & 0xfff);
+
+  if (pass == ENGINE_RENDER_PASS_TRANSPARENT) {
+    depth_key = 0xffffff - depth_key;
+    return ((uint64_t)pass << 60) | (depth_key << 36) | state_key;
+  }
+  return ((uint64_t)pass << 60) | (state_key << 24) | depth_key;
+}
+
+void engine_render_queue_begin(void) {
+  if (engine_render_queue.items == NULL) {
+    engine_render_queue.items = list_render_item_alloc();
+    engine_render_queue.batches = list_render_batch_alloc();
+    engine_render_queue.commands = list_draw_elements_command_alloc();
+    engine_render_queue.instance_stream = engine_stream_buffer_alloc(
+        GL_ARRAY_BUFFER, ENGINE_RENDER_INSTANCES_SIZE);
+    engine_render_queue.command_stream = engine_stream_buffer_alloc(
+        GL_DRAW_INDIRECT_BUFFER, ENGINE_RENDER_COMMANDS_SIZE);
+  }
+  list_render_item_clear(engine_render_queue.items);
+  engine_render_queue.scope = NULL;
+}
+
+// times the draws submitted from now on under the GPU profiler scope 'name',
+// nested in the scope of their pass. NULL stops tagging draws. does nothing
+// unless scopes are enabled.
+void engine_render_queue_scope(const char *name) {
+  engine_render_queue.scope = engine_render_queue.is_scoped ? name : NULL;
+}
+
+// draws with different scopes cannot share a batch, so timing them costs
+// draw calls. scopes are off by default and only passes are timed.
+void engine_render_queue_scopes_enable(const bool is_enabled) {
+  engine_render_queue.is_scoped = is_enabled;
+  if (!is_enabled) {
+    engine_render_queue.scope = NULL;
+  }
+}
+
+// the matrix is relative to the camera, so its translation is the offset
+// from the camera to the object.
+static float engine_render_depth(const GLfloat transform_matrix[16]) {
+  return sqrtf(transform_matrix[12] * transform_matrix[12] +
+               transform_matrix[13] * transform_matrix[13] +
+               transform_matrix[14] * transform_matrix[14]);
+}
+
+static void engine_render_queue_add(const struct mesh *mesh,
+                                    const GLfloat transform_matrix[16],
+                                    struct shader *shader, GLuint texture,
+                                    const enum engine_render_pass pass,
+                                    const float depth) {
+  struct render_item item = {
+      .mesh = mesh,
+      .shader = shader,
+      .texture = texture,
+      .scope = engine_render_queue.scope,
+  };
+  memcpy(item.transform_matrix, transform_matrix,
+         sizeof(item.transform_matrix));
+  item.key =
+      engine_render_key(pass, shader->program, texture, mesh->VAO, depth);
+
+  list_render_item_add(&engine_render_queue.items, item);
+}
+
+// queues 'mesh' for drawing with a camera-relative model matrix. a shader
+// that is still compiling is replaced by its fallback, and the draw is
+// dropped if there is none.
+void engine_render_queue_submit(const struct mesh *mesh,
+                                const GLfloat transform_matrix[16],
+                                struct shader *shader, GLuint texture,
+                                const enum engine_render_pass pass) {
+  shader = engine_shader_resolve(shader);
+  if (shader == NULL) {
+    return;
+  }
+  engine_render_queue_add(mesh, transform_matrix, shader, texture, pass,
+                          engine_render_depth(transform_matrix));
+}
+
+// like engine_render_queue_submit, but draws with the cheapest ready variant
+// of 'variants' that fits 'features' at this draw's depth.
+void engine_render_queue_submit_variant(const struct mesh *mesh,
+                                        const GLfloat transform_matrix[16],
+                                        struct shader_variants *variants,
+                                        const unsigned int features,
+                                        GLuint texture,
+                                        const enum engine_render_pass pass) {
+  const float depth = engine_render_depth(transform_matrix);
+  struct shader *shader =
+      engine_shader_variant_select(variants, features, depth);
+  if (shader == NULL) {
+    return;
+  }
+  engine_render_queue_add(mesh, transform_matrix, shader, texture, pass,
+                          depth);
+}
+
+static int engine_render_item_compare(const void *a, const void *b) {
+  const uint64_t key_a = ((const struct render_item *)a)->key;
+  const uint64_t key_b = ((const struct render_item *)b)->key;
+  return (key_a > key_b) - (key_a < key_b);
+}
+
+static bool engine_render_item_shares_state(const struct render_item *a,
+                                            const struct render_item *b) {
+  return a->mesh->VAO == b->mesh->VAO &&
+         a->mesh->use_clockwise_winding == b->mesh->use_clockwise_winding &&
+         a->shader->program == b->shader->program && a->texture == b->texture &&
+         // while profiling, draws timed under different scopes are kept
+         // apart so each scope only measures its own draws.
+         (a->scope == b->scope || !engine_gpu_profiler_is_enabled());
+}
+
+static bool engine_render_item_batches_with(const struct render_item *a,
+                                            const struct render_item *b) {
+  return a->mesh == b->mesh && engine_render_item_shares_state(a, b);
+}
+
+// points the per-instance attributes of the bound vertex array at this
+// frame's instance data, starting at instance 'first'.
+static void engine_render_instance_attributes_set(const GLuint first) {
+  const GLintptr offset = engine_render_queue.instance_offset +
+                          first * sizeof(struct render_instance);
+
+  glBindBuffer(GL_ARRAY_BUFFER, engine_render_queue.instance_stream.buffer);
+  for (GLuint column = 0; column < 4; column++) {
+    const GLuint location = ENGINE_ATTRIBUTE_TRANSFORM_MATRIX + column;
+    glVertexAttribPointer(
+        location, 4, GL_FLOAT, GL_FALSE, sizeof(struct render_instance),
+        (void *)(offset + offsetof(struct render_instance, transform_matrix) +
+                 column * 4 * sizeof(GLfloat)));
+    glVertexAttribDivisor(location, 1);
+    glEnableVertexAttribArray(location);
+  }
+  for (GLuint column = 0; column < 3; column++) {
+    const GLuint location = ENGINE_ATTRIBUTE_NORMAL_MATRIX + column;
+    glVertexAttribPointer(
+        location, 3, GL_FLOAT, GL_FALSE, sizeof(struct render_instance),
+        (void *)(offset + offsetof(struct render_instance, normal_matrix) +
+                 column * 3 * sizeof(GLfloat)));
+    glVertexAttribDivisor(location, 1);
+    glEnableVertexAttribArray(location);
+  }
+}
+
+// writes every queued model matrix and its normal matrix, in sorted order,
+// into the instance stream buffer. the normal matrix is constant per draw,
+// so it is computed here once rather than per vertex in the shader. returns
+// false if the buffer could not be mapped.
+static bool engine_render_instances_upload(const list_size count) {
+  struct render_instance *instances = engine_stream_buffer_map(
+      &engine_render_queue.instance_stream,
+      count * sizeof(struct render_instance), 4 * sizeof(GLfloat),
+      &engine_render_queue.instance_offset);
+  if (instances == NULL) {
+    engine_error("failed to map the instance buffer");
+    return false;
+  }
+
+  for (list_size i = 0; i < count; i++) {
+    const GLfloat *transform_matrix =
+        engine_render_queue.items[i].transform_matrix;
+    memcpy(instances[i].transform_matrix, transform_matrix,
+           sizeof(instances[i].transform_matrix));
+    mathf_mat4_normal_matrix(instances[i].normal_matrix, transform_matrix);
+  }
+
+  engine_stream_buffer_unmap(&engine_render_queue.instance_stream);
+  return true;
+}
+
+// splits the sorted queue into runs of items that can be drawn instanced.
+static void engine_render_batches_build(const list_size count) {
+  list_render_batch_clear(engine_render_queue.batches);
+
+  for (list_size i = 0; i < count;) {
+    struct render_batch batch = {.first = i, .count = 1};
+    while (i + batch.count < count &&
+           engine_render_item_batches_with(
+               &engine_render_queue.items[i],
+               &engine_render_queue.items[i + batch.count])) {
+      batch.count++;
+    }
+    list_render_batch_add(&engine_render_queue.batches, batch);
+    i += batch.count;
+  }
+}
+
+// writes one indirect command per batch of a pooled mesh, in batch order,
+// into the indirect stream buffer. returns false if it could not be mapped.
+static bool engine_render_commands_upload(void) {
+  list_draw_elements_command_clear(engine_render_queue.commands);
+
+  for (list_size i = 0;
+       i < list_render_batch_count(engine_render_queue.batches); i++) {
+    const struct render_batch batch = engine_render_queue.batches[i];
+    const struct mesh *mesh = engine_render_queue.items[batch.first].mesh;
+    if (!mesh->is_pooled) {
+      continue;
+    }
+    list_draw_elements_command_add(
+        &engine_render_queue.commands,
+        (draw_elements_command){
+            .count = mesh->indices_count,
+            .instance_count = batch.count,
+            .first_index = mesh->first_index,
+            .base_vertex = mesh->base_vertex,
+            .base_instance = batch.first,
+        });
+  }
+
+  const list_size count =
+      list_draw_elements_command_count(engine_render_queue.commands);
+  if (count == 0) {
+    return true;
+  }
+
+  void *commands = engine_stream_buffer_map(
+      &engine_render_queue.command_stream,
+      count * sizeof(draw_elements_command), sizeof(GLuint),
+      &engine_render_queue.command_offset);
+  if (commands == NULL) {
+    engine_error("failed to map the indirect buffer");
+    return false;
+  }
+  memcpy(commands, engine_render_queue.commands,
+         count * sizeof(draw_elements_command));
+  engine_stream_buffer_unmap(&engine_render_queue.command_stream);
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,
+               engine_render_queue.command_stream.buffer);
+  return true;
+}
+
+static void engine_render_batch_draw(const struct render_batch batch,
+                                     const bool has_base_instance) {
+  const struct mesh *mesh = engine_render_queue.items[batch.first].mesh;
+  const void *indices = (const void *)(mesh->first_index * sizeof(GLuint));
+
+  if (has_base_instance) {
+    if (mesh->use_indexed_draw) {
+      glDrawElementsInstancedBaseVertexBaseInstance(
+          GL_TRIANGLES, mesh->indices_count, GL_UNSIGNED_INT, indices,
+          batch.count, mesh->base_vertex, batch.first);
+    } else {
+      glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, mesh->vertices_count,
+                                        batch.count, batch.first);
+    }
+  } else {
+    if (mesh->use_indexed_draw) {
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh->indices_count,
+                                        GL_UNSIGNED_INT, indices, batch.count,
+                                        mesh->base_vertex);
+    } else {
+      glDrawArraysInstanced(GL_TRIANGLES, 0, mesh->vertices_count,
+                            batch.count);
+    }
+  }
+}
+
+static unsigned long engine_render_batch_triangles(
+    const struct render_batch batch) {
+  const struct mesh *mesh = engine_render_queue.items[batch.first].mesh;
+  const GLuint count =
+      mesh->use_indexed_draw ? mesh->indices_count : mesh->vertices_count;
+  return (unsigned long)(count / 3) * batch.count;
+}
+
+// sorts the queued draws and submits them, only touching GL state that
+// differs from the previous draw.
+void engine_render_queue_flush(void) {
+  const list_size count = list_render_item_count(engine_render_queue.items);
+  if (count == 0) {
+    engine_render_queue.stats = (struct engine_render_stats){0};
+    return;
+  }
+
+  engine_profiler_begin("sort draws");
+  qsort(engine_render_queue.items, count, sizeof(struct render_item),
+        engine_render_item_compare);
+  engine_profiler_end();
+
+  engine_profiler_begin("upload instances");
+  const bool is_uploaded = engine_render_instances_upload(count);
+  engine_profiler_end();
+  if (!is_uploaded) {
+    return;
+  }
+
+  engine_render_batches_build(count);
+
+  // with base instance support the attribute pointers can stay at instance
+  // 0 and each draw selects its range; otherwise they move with every batch.
+  const bool has_base_instance =
+      glad_glDrawElementsInstancedBaseInstance != NULL;
+  const bool has_multi_draw_indirect =
+      glad_glMultiDrawElementsIndirect != NULL &&
+      engine_render_commands_upload();
+
+  struct engine_render_stats stats = {0};
+
+  engine_profiler_begin("submit draws");
+
+  // state is unknown at the start of the frame, so the first draw sets all
+  // of it.
+  GLenum front_face = GL_NONE;
+  GLuint program = 0, texture = 0, VAO = 0;
+  enum engine_render_pass pass = ENGINE_RENDER_PASS_OPAQUE;
+  const char *scope = NULL;
+  bool first = true;
+  list_size command = 0;
+
+  glActiveTexture(GL_TEXTURE0);
+
+  const list_size batches_count =
+      list_render_batch_count(engine_render_queue.batches);
+  for (list_size i = 0; i < batches_count;) {
+    const struct render_batch batch = engine_render_queue.batches[i];
+    const struct render_item *item = &engine_render_queue.items[batch.first];
+    const struct mesh *mesh = item->mesh;
+
+    // every pass is a GPU profiler scope, with the draws' own scopes nested
+    // in it.
+    const enum engine_render_pass item_pass = item->key >> 60;
+    if (first || item_pass != pass || item->scope != scope) {
+      if (!first && scope != NULL) {
+        engine_gpu_profiler_end();
+      }
+      if (first || item_pass != pass) {
+        if (!first) {
+          engine_gpu_profiler_end();
+        }
+        engine_gpu_profiler_begin(engine_render_pass_names[item_pass]);
+        pass = item_pass;
+      }
+      if (item->scope != NULL) {
+        engine_gpu_profiler_begin(item->scope);
+      }
+      scope = item->scope;
+    }
+
+    const GLenum item_front_face =
+        mesh->use_clockwise_winding ? GL_CW : GL_CCW;
+    if (first || item_front_face != front_face) {
+      glFrontFace(item_front_face);
+      front_face = item_front_face;
+      stats.front_face_changes++;
+    }
+
+    if (first || item->shader->program != program) {
+      glUseProgram(item->shader->program);
+      program = item->shader->program;
+      stats.program_changes++;
+
+      glUniform1i(engine_shader_uniform_location(item->shader,
+                                                 ENGINE_UNIFORM_DIFFUSE_MAP),
+                  0);
+    }
+
+    if (first || item->texture != texture) {
+      glBindTexture(engine_texture_target(item->texture), item->texture);
+      texture = item->texture;
+      stats.texture_changes++;
+    }
+
+    if (first || mesh->VAO != VAO) {
+      glBindVertexArray(mesh->VAO);
+      VAO = mesh->VAO;
+      stats.vertex_array_changes++;
+
+      if (has_base_instance) {
+        engine_render_instance_attributes_set(0);
+      }
+    }
+
+    first = false;
+
+    if (has_multi_draw_indirect && mesh->is_pooled) {
+      // every following batch of a pooled mesh with the same state has the
+      // next command in the indirect buffer.
+      list_size commands = 1;
+      stats.instances += batch.count;
+      stats.triangles += engine_render_batch_triangles(batch);
+      while (i + commands < batches_count) {
+        const struct render_batch next =
+            engine_render_queue.batches[i + commands];
+        const struct render_item *next_item =
+            &engine_render_queue.items[next.first];
+        if (!next_item->mesh->is_pooled ||
+            !engine_render_item_shares_state(item, next_item)) {
+          break;
+        }
+        stats.instances += next.count;
+        stats.triangles += engine_render_batch_triangles(next);
+        commands++;
+      }
+
+      glMultiDrawElementsIndirect(
+          GL_TRIANGLES, GL_UNSIGNED_INT,
+          (const void *)(engine_render_queue.command_offset +
+                         command * sizeof(draw_elements_command)),
+          commands, 0);
+      stats.draw_calls++;
+      stats.indirect_commands += commands;
+
+      command += commands;
+      i += commands;
+      continue;
+    }
+
+    if (!has_base_instance) {
+      engine_render_instance_attributes_set(batch.first);
+    }
+
+    engine_render_batch_draw(batch, has_base_instance);
+    stats.draw_calls++;
+    stats.instances += batch.count;
+    stats.triangles += engine_render_batch_triangles(batch);
+
+    i++;
+  }
+
+  if (scope != NULL) {
+    engine_gpu_profiler_end();
+  }
+  engine_gpu_profiler_end();
+
+  engine_profiler_end();
+
+  engine_render_queue.stats = stats;
+}
+
+struct engine_render_stats engine_render_stats_get(void) {
+  return engine_render_queue.stats;
+}
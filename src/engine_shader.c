@@ -1,48 +1,430 @@
 #include "engine.h"
 #include "glad/gl.h"
 
-GLuint engine_shader_compile_source(const char *file_path,
-                                    uint32_t shader_type) {
-  struct engine_file file = engine_file_load_as_string(file_path);
+#include <string.h>
+
+typedef char *engine_name_string;
+DECLARE_AND_DEFINE_LIST(engine_name_string)
+
+// every uniform and attribute name seen by any program, indexed by its
+// interned handle. the engine's own uniforms are interned first so that their
+// handles match enum engine_uniform.
+static list_engine_name_string engine_shader_names = NULL;
+
+static const char *engine_uniform_names[ENGINE_UNIFORM_COUNT] = {
+    [ENGINE_UNIFORM_DIFFUSE_MAP] = "u_diffuse_map",
+};
+
+static engine_name engine_shader_name_find_or_add(const char *name) {
+  const list_size count = list_engine_name_string_count(engine_shader_names);
+  for (list_size i = 0; i < count; i++) {
+    if (strcmp(engine_shader_names[i], name) == 0) {
+      return i;
+    }
+  }
+  list_engine_name_string_add(&engine_shader_names, strdup(name));
+  return count;
+}
+
+engine_name engine_shader_name_intern(const char *name) {
+  if (engine_shader_names == NULL) {
+    engine_shader_names = list_engine_name_string_alloc();
+    for (int i = 0; i < ENGINE_UNIFORM_COUNT; i++) {
+      engine_shader_name_find_or_add(engine_uniform_names[i]);
+    }
+  }
+  return engine_shader_name_find_or_add(name);
+}
+
+static void engine_shader_location_set(list_GLint *locations,
+                                       const engine_name name,
+                                       const GLint location) {
+  while (list_GLint_count(*locations) <= name) {
+    list_GLint_add(locations, -1);
+  }
+  (*locations)[name] = location;
+}
+
+// queries every active uniform and attribute of the shader's program once and
+// stores their locations by interned name, so drawing never looks up a
+// location by string.
+static void engine_shader_reflect(struct shader *shader) {
+  list_GLint_clear(shader->uniform_locations);
+  list_GLint_clear(shader->attribute_locations);
+
+  GLint max_length = 0;
+  glGetProgramiv(shader->program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  GLint attribute_max_length = 0;
+  glGetProgramiv(shader->program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH,
+                 &attribute_max_length);
+  if (attribute_max_length > max_length) {
+    max_length = attribute_max_length;
+  }
+  char *name = malloc(max_length + 1);
+
+  GLint uniform_count = 0;
+  glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &uniform_count);
+  for (GLint i = 0; i < uniform_count; i++) {
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(shader->program, i, max_length + 1, NULL, &size, &type,
+                       name);
+
+    // arrays are reported as "name[0]"; store them under their plain name.
+    char *subscript = strstr(name, "[0]");
+    if (subscript != NULL) {
+      *subscript = '\0';
+    }
+
+    engine_shader_location_set(&shader->uniform_locations,
+                               engine_shader_name_intern(name),
+                               glGetUniformLocation(shader->program, name));
+  }
+
+  GLint attribute_count = 0;
+  glGetProgramiv(shader->program, GL_ACTIVE_ATTRIBUTES, &attribute_count);
+  for (GLint i = 0; i < attribute_count; i++) {
+    GLint size;
+    GLenum type;
+    glGetActiveAttrib(shader->program, i, max_length + 1, NULL, &size, &type,
+                      name);
+
+    engine_shader_location_set(&shader->attribute_locations,
+                               engine_shader_name_intern(name),
+                               glGetAttribLocation(shader->program, name));
+  }
+
+  free(name);
 
+  // per-frame constants come from a shared uniform buffer.
+  const GLuint frame_block =
+      glGetUniformBlockIndex(shader->program, "engine_frame");
+  if (frame_block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(shader->program, frame_block,
+                          ENGINE_UNIFORM_BLOCK_FRAME);
+  }
+}
+
+GLint engine_shader_uniform_location(const struct shader *shader,
+                                     const engine_name name) {
+  if (name >= list_GLint_count(shader->uniform_locations)) {
+    return -1;
+  }
+  return shader->uniform_locations[name];
+}
+
+GLint engine_shader_attribute_location(const struct shader *shader,
+                                       const engine_name name) {
+  if (name >= list_GLint_count(shader->attribute_locations)) {
+    return -1;
+  }
+  return shader->attribute_locations[name];
+}
+
+// starts compiling 'source' without waiting for the result. 'defines' (may
+// be NULL) and the engine_frame block are inserted right after the #version
+// line, which has to come first in GLSL, so a single source can be compiled
+// into several variants and no shader declares the block itself.
+static GLuint engine_shader_compile_text(const char *source,
+                                         uint32_t shader_type,
+                                         const char *defines) {
   GLuint shader = glCreateShader(shader_type);
-  const char *shader_source = file.text;
 
-  glShaderSource(shader, 1, &shader_source, NULL);
+  // split the source after the #version line and pass the insertions as
+  // separate strings in between, so the source is never copied. a #line
+  // directive keeps compile errors pointing at lines of the file.
+  const char *version = strstr(source, "#version");
+  const char *body = version != NULL ? strchr(version, '\n') : NULL;
+  body = body != NULL ? body + 1 : source;
+
+  unsigned int line = 1;
+  for (const char *c = source; c < body; c++) {
+    line += *c == '\n';
+  }
+  char line_directive[32];
+  snprintf(line_directive, sizeof(line_directive), "#line %u\n", line);
+
+  const char *sources[5] = {source, defines != NULL ? defines : "",
+                            ENGINE_FRAME_CONSTANTS_GLSL, line_directive, body};
+  const GLint lengths[5] = {body - source, -1, -1, -1, -1};
+  glShaderSource(shader, 5, sources, lengths);
   glCompileShader(shader);
 
-  engine_file_free(file);
+  return shader;
+}
 
+// logs the compile errors of 'shader', if any. 'name' is only used for the
+// message. returns false if compilation failed.
+static bool engine_shader_compile_check(const char *name, GLuint shader) {
   GLint success;
   char info_log[512];
   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
   if (!success) {
     glGetShaderInfoLog(shader, 512, NULL, info_log);
-    engine_error("vertex shader compilation failed%s", info_log);
+    engine_error("shader compilation failed for '%s'\n%s", name, info_log);
+  }
+  return success;
+}
+
+GLuint engine_shader_compile_source_with_defines(const char *file_path,
+                                                 uint32_t shader_type,
+                                                 const char *defines) {
+  struct engine_file file = engine_file_load_as_string(file_path);
+  if (file.error) {
+    engine_error("failed to load shader source '%s'", file_path);
+    return 0;
   }
 
+  GLuint shader = engine_shader_compile_text(file.text, shader_type, defines);
+  engine_shader_compile_check(file_path, shader);
+
+  engine_file_free(file);
   return shader;
 }
 
-GLuint engine_shader_create(const char *vertex_shader_file_path,
-                            const char *fragment_shader_file_path) {
+GLuint engine_shader_compile_source(const char *file_path,
+                                    uint32_t shader_type) {
+  return engine_shader_compile_source_with_defines(file_path, shader_type,
+                                                   NULL);
+}
+
+static char *engine_shader_strdup(const char *string) {
+  return string != NULL ? strdup(string) : NULL;
+}
+
+// lets the driver compile on as many threads as it likes. programs can then
+// be polled with GL_COMPLETION_STATUS_KHR instead of blocking on their
+// status.
+static bool engine_shader_parallel_compile_init(void) {
+  static bool is_initialized = false;
+  static bool has_parallel_compile = false;
+  if (!is_initialized) {
+    is_initialized = true;
+    if (glad_glMaxShaderCompilerThreadsKHR != NULL) {
+      glMaxShaderCompilerThreadsKHR(0xffffffff);
+      has_parallel_compile = true;
+    } else if (glad_glMaxShaderCompilerThreadsARB != NULL) {
+      glMaxShaderCompilerThreadsARB(0xffffffff);
+      has_parallel_compile = true;
+    }
+  }
+  return has_parallel_compile;
+}
+
+// starts building a program from a vertex and a fragment shader file and
+// returns without waiting for the driver. a cached program binary is used
+// when the sources and driver are unchanged. compile and link results are
+// only queried once the program is needed, see engine_shader_is_ready.
+static struct shader *engine_shader_build(const char *vertex_shader_file_path,
+                                          const char *fragment_shader_file_path,
+                                          const char *defines) {
 
   engine_log("creating shader program from:\n\t%s\n\t%s",
              vertex_shader_file_path, fragment_shader_file_path);
 
-  GLuint vertex_shader =
-      engine_shader_compile_source(vertex_shader_file_path, GL_VERTEX_SHADER);
+  engine_shader_parallel_compile_init();
+
+  struct shader *shader = calloc(1, sizeof(*shader));
+  shader->vertex_shader_file_path =
+      engine_shader_strdup(vertex_shader_file_path);
+  shader->fragment_shader_file_path =
+      engine_shader_strdup(fragment_shader_file_path);
+  shader->defines = engine_shader_strdup(defines);
+  shader->uniform_locations = list_GLint_alloc();
+  shader->attribute_locations = list_GLint_alloc();
+
+  struct engine_file vertex_file =
+      engine_file_load_as_string(vertex_shader_file_path);
+  struct engine_file fragment_file =
+      engine_file_load_as_string(fragment_shader_file_path);
+  if (vertex_file.error || fragment_file.error) {
+    engine_error("failed to load shader sources");
+    engine_file_free(vertex_file);
+    engine_file_free(fragment_file);
+    shader->status = ENGINE_SHADER_FAILED;
+    return shader;
+  }
+
+  shader->cache_key = engine_shader_cache_key(vertex_file.text,
+                                              fragment_file.text, defines);
+  shader->program = engine_shader_cache_load(shader->cache_key);
+
+  if (shader->program != 0) {
+    engine_log("loaded shader program from cache");
+    shader->status = ENGINE_SHADER_READY;
+    engine_shader_reflect(shader);
+  } else {
+    shader->vertex_shader =
+        engine_shader_compile_text(vertex_file.text, GL_VERTEX_SHADER, defines);
+    shader->fragment_shader = engine_shader_compile_text(
+        fragment_file.text, GL_FRAGMENT_SHADER, defines);
+
+    shader->program = glCreateProgram();
+    glAttachShader(shader->program, shader->vertex_shader);
+    glAttachShader(shader->program, shader->fragment_shader);
+    if (glad_glProgramParameteri != NULL) {
+      glProgramParameteri(shader->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    }
+    glLinkProgram(shader->program);
+    shader->status = ENGINE_SHADER_PENDING;
+  }
+
+  engine_file_free(vertex_file);
+  engine_file_free(fragment_file);
 
-  GLuint fragment_shader = engine_shader_compile_source(
-      fragment_shader_file_path, GL_FRAGMENT_SHADER);
+  return shader;
+}
 
-  GLuint shader_program;
-  shader_program = glCreateProgram();
-  glAttachShader(shader_program, vertex_shader);
-  glAttachShader(shader_program, fragment_shader);
-  glLinkProgram(shader_program);
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
+// like engine_shader_build, and registers the program for hot reloading.
+struct shader *engine_shader_load(const char *vertex_shader_file_path,
+                                  const char *fragment_shader_file_path,
+                                  const char *defines) {
+  struct shader *shader = engine_shader_build(
+      vertex_shader_file_path, fragment_shader_file_path, defines);
+  engine_shader_watch_add(shader);
+  return shader;
+}
+
+// checks the results of a pending build. blocks if the driver is not done.
+static void engine_shader_finish(struct shader *shader) {
+  bool success = engine_shader_compile_check(shader->vertex_shader_file_path,
+                                             shader->vertex_shader);
+  success = engine_shader_compile_check(shader->fragment_shader_file_path,
+                                        shader->fragment_shader) &&
+            success;
+
+  GLint linked;
+  glGetProgramiv(shader->program, GL_LINK_STATUS, &linked);
+  if (success && !linked) {
+    char info_log[512];
+    glGetProgramInfoLog(shader->program, 512, NULL, info_log);
+    engine_error("shader program linking failed\n%s", info_log);
+  }
 
-  return shader_program;
+  glDeleteShader(shader->vertex_shader);
+  glDeleteShader(shader->fragment_shader);
+  shader->vertex_shader = shader->fragment_shader = 0;
+
+  if (!linked) {
+    shader->status = ENGINE_SHADER_FAILED;
+    return;
+  }
+
+  engine_shader_cache_store(shader->cache_key, shader->program);
+  engine_shader_reflect(shader);
+  shader->status = ENGINE_SHADER_READY;
+}
+
+// returns true once the program can be used. with parallel shader compile
+// this never blocks; without it, the first call waits for the driver.
+bool engine_shader_is_ready(struct shader *shader) {
+  if (shader->status == ENGINE_SHADER_PENDING) {
+    if (engine_shader_parallel_compile_init()) {
+      GLint completed = GL_FALSE;
+      glGetProgramiv(shader->program, GL_COMPLETION_STATUS_KHR, &completed);
+      if (!completed) {
+        return false;
+      }
+    }
+    engine_shader_finish(shader);
+  }
+  return shader->status == ENGINE_SHADER_READY;
+}
+
+// waits for the program to be built. returns false if it failed.
+bool engine_shader_wait(struct shader *shader) {
+  if (shader->status == ENGINE_SHADER_PENDING) {
+    engine_shader_finish(shader);
+  }
+  return shader->status == ENGINE_SHADER_READY;
+}
+
+// returns the program to draw with in place of 'shader': itself once ready,
+// otherwise the first ready fallback, or NULL if there is none yet.
+struct shader *engine_shader_resolve(struct shader *shader) {
+  while (shader != NULL && !engine_shader_is_ready(shader)) {
+    shader = shader->fallback;
+  }
+  return shader;
+}
+
+struct shader *
+engine_shader_create_with_defines(const char *vertex_shader_file_path,
+                                  const char *fragment_shader_file_path,
+                                  const char *defines) {
+  struct shader *shader = engine_shader_load(
+      vertex_shader_file_path, fragment_shader_file_path, defines);
+  engine_shader_wait(shader);
+  return shader;
+}
+
+struct shader *engine_shader_create(const char *vertex_shader_file_path,
+                                    const char *fragment_shader_file_path) {
+  return engine_shader_create_with_defines(vertex_shader_file_path,
+                                           fragment_shader_file_path, NULL);
+}
+
+// starts rebuilding 'shader' from its files in the background. the current
+// program stays in use until engine_shader_reload_update swaps it.
+void engine_shader_reload(struct shader *shader) {
+  if (shader->reload != NULL) {
+    engine_shader_free(shader->reload);
+  }
+  shader->reload = engine_shader_build(shader->vertex_shader_file_path,
+                                       shader->fragment_shader_file_path,
+                                       shader->defines);
+}
+
+// swaps in a finished reload of 'shader'. a reload that failed to build is
+// dropped and the previous program is kept. must be called between frames,
+// so a frame is drawn with either the old or the new program but never both.
+void engine_shader_reload_update(struct shader *shader) {
+  struct shader *reload = shader->reload;
+  if (reload == NULL || !engine_shader_is_ready(reload)) {
+    if (reload != NULL && reload->status == ENGINE_SHADER_FAILED) {
+      engine_warn("reloading '%s' failed, keeping the previous program",
+                  shader->fragment_shader_file_path);
+      engine_shader_free(reload);
+      shader->reload = NULL;
+    }
+    return;
+  }
+
+  // the reload takes the old program with it when it is freed.
+  const GLuint program = shader->program;
+  const list_GLint uniform_locations = shader->uniform_locations;
+  const list_GLint attribute_locations = shader->attribute_locations;
+
+  shader->program = reload->program;
+  shader->uniform_locations = reload->uniform_locations;
+  shader->attribute_locations = reload->attribute_locations;
+  shader->cache_key = reload->cache_key;
+  shader->status = ENGINE_SHADER_READY;
+
+  reload->program = program;
+  reload->uniform_locations = uniform_locations;
+  reload->attribute_locations = attribute_locations;
+  engine_shader_free(reload);
+  shader->reload = NULL;
+
+  engine_log("reloaded shader program from:\n\t%s\n\t%s",
+             shader->vertex_shader_file_path,
+             shader->fragment_shader_file_path);
+}
+
+void engine_shader_free(struct shader *shader) {
+  engine_shader_watch_remove(shader);
+  if (shader->reload != NULL) {
+    engine_shader_free(shader->reload);
+  }
+  glDeleteShader(shader->vertex_shader);
+  glDeleteShader(shader->fragment_shader);
+  glDeleteProgram(shader->program);
+  free(shader->vertex_shader_file_path);
+  free(shader->fragment_shader_file_path);
+  free(shader->defines);
+  list_GLint_free(shader->uniform_locations);
+  list_GLint_free(shader->attribute_locations);
+  free(shader);
 }
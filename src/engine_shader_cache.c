@@ -0,0 +1,185 @@
+#include "engine.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Linked program binaries kept on disk between runs. Entries are keyed by a
+// hash of the program's sources and of the driver that produced them, so a
+// changed source or a driver update never matches an old entry. A binary the
+// driver still refuses is treated as a miss: the program is rebuilt from
+// source and the entry overwritten.
+
+#define ENGINE_SHADER_CACHE_MAGIC (0x313043485342524full /* "ORBSHC01" */)
+
+struct engine_shader_cache_header {
+  uint64_t magic;
+  uint64_t key;
+  uint32_t format;
+  uint32_t length;
+};
+
+// 64-bit FNV-1a. pass ENGINE_HASH_SEED to start a new hash, or a previous
+// result to continue it.
+uint64_t engine_hash(const void *data, const size_t size, uint64_t hash) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static bool engine_shader_cache_is_supported(void) {
+  if (glad_glProgramBinary == NULL || glad_glGetProgramBinary == NULL) {
+    return false;
+  }
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+static uint64_t engine_hash_string(const char *string, uint64_t hash) {
+  if (string == NULL) {
+    string = "";
+  }
+  // include the terminator so consecutive strings cannot run together.
+  return engine_hash(string, strlen(string) + 1, hash);
+}
+
+uint64_t engine_shader_cache_key(const char *vertex_source,
+                                 const char *fragment_source,
+                                 const char *defines) {
+  uint64_t hash = ENGINE_HASH_SEED;
+  hash = engine_hash_string(vertex_source, hash);
+  hash = engine_hash_string(fragment_source, hash);
+  hash = engine_hash_string(defines, hash);
+  hash = engine_hash_string(ENGINE_FRAME_CONSTANTS_GLSL, hash);
+
+  const GLenum driver_strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION,
+                                   GL_SHADING_LANGUAGE_VERSION};
+  for (size_t i = 0; i < sizeof(driver_strings) / sizeof(*driver_strings);
+       i++) {
+    hash = engine_hash_string((const char *)glGetString(driver_strings[i]),
+                              hash);
+  }
+  return hash;
+}
+
+static void engine_shader_cache_path(char *path, const size_t size,
+                                     const uint64_t key) {
+  snprintf(path, size, "%s/%016llx.bin", ENGINE_SHADER_CACHE_DIRECTORY,
+           (unsigned long long)key);
+}
+
+// creates every directory along ENGINE_SHADER_CACHE_DIRECTORY.
+static bool engine_shader_cache_directory_create(void) {
+  char path[] = ENGINE_SHADER_CACHE_DIRECTORY;
+  for (char *c = path + 1;; c++) {
+    if (*c != '/' && *c != '\0') {
+      continue;
+    }
+    const char end = *c;
+    *c = '\0';
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+      engine_warn("failed to create shader cache directory '%s'", path);
+      return false;
+    }
+    *c = end;
+    if (end == '\0') {
+      return true;
+    }
+  }
+}
+
+// returns a linked program created from the cache entry for 'key', or 0 if
+// there is no usable entry.
+GLuint engine_shader_cache_load(const uint64_t key) {
+  if (!engine_shader_cache_is_supported()) {
+    return 0;
+  }
+
+  char path[256];
+  engine_shader_cache_path(path, sizeof(path), key);
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+
+  struct engine_shader_cache_header header;
+  void *binary = NULL;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               header.magic == ENGINE_SHADER_CACHE_MAGIC &&
+               header.key == key && header.length > 0;
+  if (valid) {
+    binary = malloc(header.length);
+    valid = fread(binary, 1, header.length, file) == header.length;
+  }
+  fclose(file);
+
+  GLuint program = 0;
+  if (valid) {
+    program = glCreateProgram();
+    glProgramBinary(program, header.format, binary, header.length);
+
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+      glDeleteProgram(program);
+      program = 0;
+    }
+  }
+  free(binary);
+
+  if (program == 0) {
+    engine_warn("discarding stale shader cache entry '%s'", path);
+  }
+  return program;
+}
+
+// writes the binary of the linked 'program' to the cache entry for 'key'.
+// the program should have been linked with
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+void engine_shader_cache_store(const uint64_t key, const GLuint program) {
+  if (!engine_shader_cache_is_supported()) {
+    return;
+  }
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0 || !engine_shader_cache_directory_create()) {
+    return;
+  }
+
+  struct engine_shader_cache_header header = {
+      .magic = ENGINE_SHADER_CACHE_MAGIC,
+      .key = key,
+  };
+  void *binary = malloc(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, NULL, &format, binary);
+  header.format = format;
+  header.length = length;
+
+  char path[256];
+  engine_shader_cache_path(path, sizeof(path), key);
+
+  // write to a temporary file first so a crash never leaves a torn entry.
+  char temporary_path[sizeof(path) + 4];
+  snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+  FILE *file = fopen(temporary_path, "wb");
+  bool written = file != NULL &&
+                 fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(binary, 1, length, file) == (size_t)length;
+  if (file != NULL) {
+    written = fclose(file) == 0 && written;
+  }
+  free(binary);
+
+  if (!written || rename(temporary_path, path) != 0) {
+    engine_warn("failed to write shader cache entry '%s'", path);
+    remove(temporary_path);
+  }
+}
@@ -0,0 +1,146 @@
+#include "engine.h"
+
+#include <string.h>
+
+// Preprocessor permutations of one pair of shader files. A variant is the
+// set of features it was compiled with; its define block is generated from
+// the feature mask in declaration order, so equal sets always produce equal
+// sources and share one entry in the program binary cache, which is keyed by
+// the hash of the sources and the define block.
+//
+// Variants are compiled asynchronously the first time they are requested.
+// Until one is ready, draws asking for it get the ready variant with the most
+// of the requested features, as long as it keeps every required one, and
+// otherwise the family's fallback.
+
+struct shader_variants *
+engine_shader_variants_alloc(const char *vertex_shader_file_path,
+                             const char *fragment_shader_file_path,
+                             const struct shader_feature *features,
+                             const unsigned int features_count) {
+  if (features_count > ENGINE_SHADER_FEATURES_MAX) {
+    engine_error("too many shader features (%u, at most %d)", features_count,
+                 ENGINE_SHADER_FEATURES_MAX);
+    return NULL;
+  }
+
+  struct shader_variants *variants = calloc(1, sizeof(*variants));
+  variants->vertex_shader_file_path = strdup(vertex_shader_file_path);
+  variants->fragment_shader_file_path = strdup(fragment_shader_file_path);
+  for (unsigned int i = 0; i < features_count; i++) {
+    variants->features[i] = features[i];
+  }
+  variants->features_count = features_count;
+  return variants;
+}
+
+void engine_shader_variants_free(struct shader_variants *variants) {
+  if (variants == NULL) {
+    return;
+  }
+  for (unsigned int i = 0; i < (1u << variants->features_count); i++) {
+    if (variants->variants[i] != NULL) {
+      engine_shader_free(variants->variants[i]);
+    }
+  }
+  free(variants->vertex_shader_file_path);
+  free(variants->fragment_shader_file_path);
+  free(variants);
+}
+
+// returns the variant compiled with 'features', starting its compile if it
+// was never requested before. the result may still be pending.
+struct shader *engine_shader_variant_request(struct shader_variants *variants,
+                                             const unsigned int features) {
+  const unsigned int mask = features & ((1u << variants->features_count) - 1);
+  if (variants->variants[mask] != NULL) {
+    return variants->variants[mask];
+  }
+
+  size_t defines_length = 1;
+  for (unsigned int i = 0; i < variants->features_count; i++) {
+    if (mask & (1u << i)) {
+      defines_length +=
+          strlen("#define \n") + strlen(variants->features[i].define);
+    }
+  }
+
+  char *defines = malloc(defines_length);
+  defines[0] = '\0';
+  for (unsigned int i = 0; i < variants->features_count; i++) {
+    if (mask & (1u << i)) {
+      strcat(defines, "#define ");
+      strcat(defines, variants->features[i].define);
+      strcat(defines, "\n");
+    }
+  }
+
+  variants->variants[mask] =
+      engine_shader_load(variants->vertex_shader_file_path,
+                         variants->fragment_shader_file_path, defines);
+  free(defines);
+  return variants->variants[mask];
+}
+
+static unsigned int engine_shader_feature_count(unsigned int features) {
+  unsigned int count = 0;
+  for (; features != 0; features &= features - 1) {
+    count++;
+  }
+  return count;
+}
+
+// returns the cheapest ready variant that fits a draw at 'depth' asking for
+// 'features', or NULL if nothing can be drawn yet. features past their
+// max_depth are left out of the request, unless they are required.
+struct shader *engine_shader_variant_select(struct shader_variants *variants,
+                                            unsigned int features,
+                                            const float depth) {
+  for (unsigned int i = 0; i < variants->features_count; i++) {
+    const float max_depth = variants->features[i].max_depth;
+    if (max_depth > 0 && depth > max_depth &&
+        !variants->features[i].is_required) {
+      features &= ~(1u << i);
+    }
+  }
+  features &= (1u << variants->features_count) - 1;
+
+  unsigned int required = 0;
+  for (unsigned int i = 0; i < variants->features_count; i++) {
+    if (variants->features[i].is_required) {
+      required |= 1u << i;
+    }
+  }
+  required &= features;
+
+  struct shader *shader = engine_shader_variant_request(variants, features);
+  if (engine_shader_is_ready(shader)) {
+    return shader;
+  }
+
+  // walk every proper subset of the requested features for the ready
+  // variant closest to the request. only variants that were requested
+  // before are considered, nothing new is compiled here, and subsets missing
+  // a required feature would draw with the wrong interface.
+  struct shader *closest = NULL;
+  unsigned int closest_count = 0;
+  for (unsigned int subset = (features - 1) & features;;
+       subset = (subset - 1) & features) {
+    struct shader *candidate = variants->variants[subset];
+    const unsigned int count = engine_shader_feature_count(subset);
+    if (candidate != NULL && (subset & required) == required &&
+        (closest == NULL || count > closest_count) &&
+        engine_shader_is_ready(candidate)) {
+      closest = candidate;
+      closest_count = count;
+    }
+    if (subset == 0) {
+      break;
+    }
+  }
+  if (closest != NULL) {
+    return closest;
+  }
+
+  return engine_shader_resolve(variants->fallback);
+}
@@ -0,0 +1,284 @@
+#include "engine.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Shader hot reloading. Every program made by engine_shader_load is kept in
+// a watch table, and the directories of its files are watched with inotify.
+// A background thread only collects the paths of files that were written;
+// all GL work stays on the main thread, which restarts the builds of the
+// affected programs in engine_shader_watch_update and swaps each one in once
+// it is ready. A program that fails to build keeps the previous one.
+
+// how long the watch thread blocks before checking whether it should stop.
+#define ENGINE_SHADER_WATCH_POLL_TIMEOUT (100 /* milliseconds */)
+
+#define ENGINE_SHADER_WATCH_PATH_MAX (256)
+
+typedef struct shader *shader_ptr;
+
+struct engine_shader_watch_path {
+  int descriptor;
+  char path[ENGINE_SHADER_WATCH_PATH_MAX];
+};
+typedef struct engine_shader_watch_path engine_shader_watch_path;
+
+DECLARE_AND_DEFINE_LIST(shader_ptr)
+DECLARE_AND_DEFINE_LIST(engine_shader_watch_path)
+
+static struct {
+  list_shader_ptr shaders;
+  // watched directories, by inotify watch descriptor.
+  list_engine_shader_watch_path directories;
+  // files written since the last update. shared with the watch thread.
+  list_engine_shader_watch_path changed;
+  pthread_mutex_t lock;
+  pthread_t thread;
+  atomic_bool is_running;
+  int inotify;
+} engine_shader_watch = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .inotify = -1,
+};
+
+static void engine_shader_watch_lists_alloc(void) {
+  if (engine_shader_watch.shaders == NULL) {
+    engine_shader_watch.shaders = list_shader_ptr_alloc();
+    engine_shader_watch.directories = list_engine_shader_watch_path_alloc();
+    engine_shader_watch.changed = list_engine_shader_watch_path_alloc();
+  }
+}
+
+// adds an inotify watch on the directory holding 'file_path', unless it is
+// already watched. the caller holds the lock.
+static void engine_shader_watch_directory(const char *file_path) {
+  if (engine_shader_watch.inotify < 0 || file_path == NULL) {
+    return;
+  }
+
+  struct engine_shader_watch_path directory = {0};
+  const char *slash = strrchr(file_path, '/');
+  if (slash == NULL) {
+    strcpy(directory.path, ".");
+  } else {
+    const size_t length = slash - file_path;
+    if (length >= sizeof(directory.path)) {
+      return;
+    }
+    memcpy(directory.path, file_path, length);
+  }
+
+  for (list_size i = 0; i < list_engine_shader_watch_path_count(
+                                engine_shader_watch.directories);
+       i++) {
+    if (strcmp(engine_shader_watch.directories[i].path, directory.path) == 0) {
+      return;
+    }
+  }
+
+  // editors either rewrite a file in place or rename a new file over it.
+  directory.descriptor = inotify_add_watch(engine_shader_watch.inotify,
+                                           directory.path,
+                                           IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (directory.descriptor < 0) {
+    engine_warn("failed to watch shader directory '%s'", directory.path);
+    return;
+  }
+  list_engine_shader_watch_path_add(&engine_shader_watch.directories,
+                                    directory);
+}
+
+static void engine_shader_watch_read(void) {
+  // large enough for several events with names, and aligned like one.
+  _Alignas(struct inotify_event) char buffer[4096];
+  const ssize_t length =
+      read(engine_shader_watch.inotify, buffer, sizeof(buffer));
+  if (length <= 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&engine_shader_watch.lock);
+  for (char *next = buffer; next < buffer + length;) {
+    const struct inotify_event *event = (const struct inotify_event *)next;
+    next += sizeof(*event) + event->len;
+    if (event->len == 0) {
+      continue;
+    }
+
+    for (list_size i = 0; i < list_engine_shader_watch_path_count(
+                                  engine_shader_watch.directories);
+         i++) {
+      const struct engine_shader_watch_path *directory =
+          &engine_shader_watch.directories[i];
+      if (directory->descriptor != event->wd) {
+        continue;
+      }
+
+      // a path too long to keep cannot belong to a registered shader.
+      struct engine_shader_watch_path changed = {.descriptor = event->wd};
+      if (snprintf(changed.path, sizeof(changed.path), "%s/%s",
+                   directory->path, event->name) >= (int)sizeof(changed.path)) {
+        break;
+      }
+
+      // an editor may write a file several times per save.
+      bool is_queued = false;
+      for (list_size j = 0; j < list_engine_shader_watch_path_count(
+                                    engine_shader_watch.changed);
+           j++) {
+        is_queued = is_queued ||
+                    strcmp(engine_shader_watch.changed[j].path,
+                           changed.path) == 0;
+      }
+      if (!is_queued) {
+        list_engine_shader_watch_path_add(&engine_shader_watch.changed,
+                                          changed);
+      }
+      break;
+    }
+  }
+  pthread_mutex_unlock(&engine_shader_watch.lock);
+}
+
+static void *engine_shader_watch_thread(void *user_data) {
+  (void)user_data;
+  engine_profiler_thread_name("shader watch");
+  struct pollfd descriptor = {
+      .fd = engine_shader_watch.inotify,
+      .events = POLLIN,
+  };
+  while (atomic_load(&engine_shader_watch.is_running)) {
+    if (poll(&descriptor, 1, ENGINE_SHADER_WATCH_POLL_TIMEOUT) > 0) {
+      engine_profiler_begin("read shader changes");
+      engine_shader_watch_read();
+      engine_profiler_end();
+    }
+  }
+  return NULL;
+}
+
+// starts watching the files of every registered shader, including those
+// registered later. returns false if hot reloading is unavailable.
+bool engine_shader_watch_start(void) {
+  if (atomic_load(&engine_shader_watch.is_running)) {
+    return true;
+  }
+
+  engine_shader_watch.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (engine_shader_watch.inotify < 0) {
+    engine_warn("failed to start shader hot reloading");
+    return false;
+  }
+
+  engine_shader_watch_lists_alloc();
+  pthread_mutex_lock(&engine_shader_watch.lock);
+  for (list_size i = 0;
+       i < list_shader_ptr_count(engine_shader_watch.shaders); i++) {
+    engine_shader_watch_directory(
+        engine_shader_watch.shaders[i]->vertex_shader_file_path);
+    engine_shader_watch_directory(
+        engine_shader_watch.shaders[i]->fragment_shader_file_path);
+  }
+  pthread_mutex_unlock(&engine_shader_watch.lock);
+
+  atomic_store(&engine_shader_watch.is_running, true);
+  if (pthread_create(&engine_shader_watch.thread, NULL,
+                     engine_shader_watch_thread, NULL) != 0) {
+    engine_warn("failed to start shader watch thread");
+    atomic_store(&engine_shader_watch.is_running, false);
+    close(engine_shader_watch.inotify);
+    engine_shader_watch.inotify = -1;
+    return false;
+  }
+  return true;
+}
+
+void engine_shader_watch_stop(void) {
+  if (!atomic_load(&engine_shader_watch.is_running)) {
+    return;
+  }
+  atomic_store(&engine_shader_watch.is_running, false);
+  pthread_join(engine_shader_watch.thread, NULL);
+
+  close(engine_shader_watch.inotify);
+  engine_shader_watch.inotify = -1;
+
+  // watch descriptors die with the inotify instance.
+  list_engine_shader_watch_path_clear(engine_shader_watch.directories);
+  list_engine_shader_watch_path_clear(engine_shader_watch.changed);
+}
+
+void engine_shader_watch_add(struct shader *shader) {
+  engine_shader_watch_lists_alloc();
+  list_shader_ptr_add(&engine_shader_watch.shaders, shader);
+
+  pthread_mutex_lock(&engine_shader_watch.lock);
+  engine_shader_watch_directory(shader->vertex_shader_file_path);
+  engine_shader_watch_directory(shader->fragment_shader_file_path);
+  pthread_mutex_unlock(&engine_shader_watch.lock);
+}
+
+void engine_shader_watch_remove(struct shader *shader) {
+  if (engine_shader_watch.shaders == NULL) {
+    return;
+  }
+  for (list_size i = 0;
+       i < list_shader_ptr_count(engine_shader_watch.shaders); i++) {
+    if (engine_shader_watch.shaders[i] == shader) {
+      list_shader_ptr_remove_at(engine_shader_watch.shaders, i);
+      return;
+    }
+  }
+}
+
+static bool engine_shader_uses_file(const struct shader *shader,
+                                    const char *path) {
+  return (shader->vertex_shader_file_path != NULL &&
+          strcmp(shader->vertex_shader_file_path, path) == 0) ||
+         (shader->fragment_shader_file_path != NULL &&
+          strcmp(shader->fragment_shader_file_path, path) == 0);
+}
+
+// restarts the builds of programs whose files changed and swaps in those
+// that finished. call once per frame, before anything is drawn.
+void engine_shader_watch_update(void) {
+  if (engine_shader_watch.shaders == NULL) {
+    return;
+  }
+
+  // take the changed paths so the watch thread is not held up by the
+  // builds below.
+  list_engine_shader_watch_path changed = NULL;
+  if (atomic_load(&engine_shader_watch.is_running)) {
+    pthread_mutex_lock(&engine_shader_watch.lock);
+    if (list_engine_shader_watch_path_count(engine_shader_watch.changed) > 0) {
+      changed = engine_shader_watch.changed;
+      engine_shader_watch.changed = list_engine_shader_watch_path_alloc();
+    }
+    pthread_mutex_unlock(&engine_shader_watch.lock);
+  }
+
+  if (changed != NULL) {
+    for (list_size i = 0; i < list_engine_shader_watch_path_count(changed);
+         i++) {
+      for (list_size j = 0;
+           j < list_shader_ptr_count(engine_shader_watch.shaders); j++) {
+        if (engine_shader_uses_file(engine_shader_watch.shaders[j],
+                                    changed[i].path)) {
+          engine_log("'%s' changed, reloading", changed[i].path);
+          engine_shader_reload(engine_shader_watch.shaders[j]);
+        }
+      }
+    }
+    list_engine_shader_watch_path_free(changed);
+  }
+
+  for (list_size i = 0;
+       i < list_shader_ptr_count(engine_shader_watch.shaders); i++) {
+    engine_shader_reload_update(engine_shader_watch.shaders[i]);
+  }
+}
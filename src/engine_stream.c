@@ -0,0 +1,171 @@
+#include "engine.h"
+
+// Streaming buffers share one ring of frame fences. engine_stream_frame_begin
+// advances to the next region and waits for the fence of the frame that used
+// it last, engine_stream_frame_end fences the commands of the current frame.
+// Each buffer lazily resets its write head the first time it is mapped in a
+// new frame.
+
+#define ENGINE_STREAM_WAIT_TIMEOUT (1000000 /* nanoseconds */)
+
+static struct {
+  GLsync fences[ENGINE_FRAME_RING_SIZE];
+  unsigned long frame;
+} engine_stream = {0};
+
+void engine_stream_frame_begin(void) {
+  engine_stream.frame++;
+  const unsigned int region = engine_stream.frame % ENGINE_FRAME_RING_SIZE;
+
+  GLsync fence = engine_stream.fences[region];
+  if (fence == NULL) {
+    return;
+  }
+
+  GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  while (result == GL_TIMEOUT_EXPIRED) {
+    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              ENGINE_STREAM_WAIT_TIMEOUT);
+  }
+  if (result == GL_WAIT_FAILED) {
+    engine_error("failed to wait for stream fence");
+  }
+
+  glDeleteSync(fence);
+  engine_stream.fences[region] = NULL;
+}
+
+void engine_stream_frame_end(void) {
+  const unsigned int region = engine_stream.frame % ENGINE_FRAME_RING_SIZE;
+  if (engine_stream.fences[region] != NULL) {
+    glDeleteSync(engine_stream.fences[region]);
+  }
+  engine_stream.fences[region] =
+      glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static void engine_stream_buffer_storage(struct engine_stream_buffer *stream) {
+  const GLsizeiptr size = stream->region_size * ENGINE_FRAME_RING_SIZE;
+
+  glGenBuffers(1, &stream->buffer);
+  glBindBuffer(stream->target, stream->buffer);
+
+  stream->mapped = NULL;
+  stream->is_persistent = false;
+
+  if (glad_glBufferStorage != NULL) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(stream->target, size, NULL, flags);
+    stream->mapped = glMapBufferRange(stream->target, 0, size, flags);
+    if (stream->mapped != NULL) {
+      stream->is_persistent = true;
+      return;
+    }
+
+    // immutable storage cannot be respecified, start over with a new buffer.
+    engine_warn("failed to map stream buffer persistently");
+    glDeleteBuffers(1, &stream->buffer);
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(stream->target, stream->buffer);
+  }
+
+  glBufferData(stream->target, size, NULL, GL_STREAM_DRAW);
+}
+
+struct engine_stream_buffer engine_stream_buffer_alloc(
+    const GLenum target, const GLsizeiptr region_size) {
+  struct engine_stream_buffer stream = {0};
+  stream.target = target;
+  stream.region_size = region_size > 0 ? region_size : 1;
+  engine_stream_buffer_storage(&stream);
+  return stream;
+}
+
+void engine_stream_buffer_free(struct engine_stream_buffer *stream) {
+  if (stream->is_persistent) {
+    glBindBuffer(stream->target, stream->buffer);
+    glUnmapBuffer(stream->target);
+  }
+  glDeleteBuffers(1, &stream->buffer);
+  glDeleteBuffers(1, &stream->retired_buffer);
+  stream->buffer = stream->retired_buffer = 0;
+  stream->mapped = NULL;
+}
+
+// reserves 'size' bytes in this frame's region and returns a pointer to write
+// them through. '*offset' receives their position in 'stream->buffer'. every
+// map must be followed by engine_stream_buffer_unmap before drawing.
+void *engine_stream_buffer_map(struct engine_stream_buffer *stream,
+                               const GLsizeiptr size,
+                               const GLsizeiptr alignment, GLintptr *offset) {
+  const unsigned int region = engine_stream.frame % ENGINE_FRAME_RING_SIZE;
+
+  if (stream->frame != engine_stream.frame) {
+    // a buffer replaced while growing is only released once a frame has
+    // passed, since draws of that frame may still have referenced it.
+    if (stream->retired_buffer != 0) {
+      glDeleteBuffers(1, &stream->retired_buffer);
+      stream->retired_buffer = 0;
+    }
+
+    // without fences, unsynchronized writes are only safe in a store the GPU
+    // has not used yet, so every pass over the ring starts with a fresh one.
+    if (!stream->is_persistent && region <= stream->region) {
+      glBindBuffer(stream->target, stream->buffer);
+      glBufferData(stream->target,
+                   stream->region_size * ENGINE_FRAME_RING_SIZE, NULL,
+                   GL_STREAM_DRAW);
+    }
+
+    stream->frame = engine_stream.frame;
+    stream->region = region;
+    stream->offset = 0;
+  }
+
+  GLintptr aligned = (stream->offset + alignment - 1) / alignment * alignment;
+
+  if (aligned + size > stream->region_size) {
+    GLsizeiptr region_size = stream->region_size * 2;
+    while (region_size < size) {
+      region_size *= 2;
+    }
+    engine_log("growing stream buffer to %ld bytes per frame",
+               (long)region_size);
+
+    if (stream->is_persistent) {
+      glBindBuffer(stream->target, stream->buffer);
+      glUnmapBuffer(stream->target);
+    }
+    glDeleteBuffers(1, &stream->retired_buffer);
+    stream->retired_buffer = stream->buffer;
+
+    stream->region_size = region_size;
+    engine_stream_buffer_storage(stream);
+    aligned = 0;
+  }
+
+  *offset = region * stream->region_size + aligned;
+  stream->offset = aligned + size;
+
+  if (stream->is_persistent) {
+    return (char *)stream->mapped + *offset;
+  }
+
+  glBindBuffer(stream->target, stream->buffer);
+  void *data = glMapBufferRange(stream->target, *offset, size,
+                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                    GL_MAP_UNSYNCHRONIZED_BIT);
+  if (data == NULL) {
+    engine_error("failed to map stream buffer %u", stream->buffer);
+  }
+  return data;
+}
+
+void engine_stream_buffer_unmap(struct engine_stream_buffer *stream) {
+  if (stream->is_persistent) {
+    return;
+  }
+  glBindBuffer(stream->target, stream->buffer);
+  glUnmapBuffer(stream->target);
+}
@@ -3,6 +3,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+// names of the textures created as cube maps. everything else is 2D.
+static list_GLuint engine_texture_cube_maps = NULL;
+
 GLuint engine_texture_alloc(const char *imageFile) {
   engine_log("Loading texture from '%s'", imageFile);
 
@@ -44,4 +47,74 @@ GLuint engine_texture_alloc(const char *imageFile) {
   return texture;
 }
 
-void engine_texture_free(GLuint texture) { glDeleteTextures(1, &texture); }
+// creates a cube map with the image on every face. non-square images are
+// cropped to their shorter side.
+GLuint engine_texture_cube_alloc(const char *imageFile) {
+  engine_log("Loading cube map from '%s'", imageFile);
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  int width, height, numChannels;
+
+  stbi_set_flip_vertically_on_load(1);
+  unsigned char *data = stbi_load(imageFile, &width, &height, &numChannels, 0);
+
+  if (data && (numChannels == 3 || numChannels == 4)) {
+    const GLenum format = numChannels == 4 ? GL_RGBA : GL_RGB;
+    const int size = width < height ? width : height;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    for (int face = 0; face < 6; face++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, format, size,
+                   size, 0, format, GL_UNSIGNED_BYTE, data);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+  } else {
+    engine_error("Failed to load cube map from '%s'", imageFile);
+  }
+
+  stbi_image_free(data);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+  if (engine_texture_cube_maps == NULL) {
+    engine_texture_cube_maps = list_GLuint_alloc();
+  }
+  list_GLuint_add(&engine_texture_cube_maps, texture);
+  return texture;
+}
+
+// returns the target 'texture' has to be bound to.
+GLenum engine_texture_target(GLuint texture) {
+  if (engine_texture_cube_maps == NULL) {
+    return GL_TEXTURE_2D;
+  }
+  for (list_size i = 0; i < list_GLuint_count(engine_texture_cube_maps); i++) {
+    if (engine_texture_cube_maps[i] == texture) {
+      return GL_TEXTURE_CUBE_MAP;
+    }
+  }
+  return GL_TEXTURE_2D;
+}
+
+void engine_texture_free(GLuint texture) {
+  for (list_size i = 0; engine_texture_cube_maps != NULL &&
+                        i < list_GLuint_count(engine_texture_cube_maps);
+       i++) {
+    if (engine_texture_cube_maps[i] == texture) {
+      list_GLuint_remove_at(engine_texture_cube_maps, i);
+      break;
+    }
+  }
+  glDeleteTextures(1, &texture);
+}
@@ -0,0 +1,115 @@
+#include "engine.h"
+
+#define TRANSFORM_ARRAY_COMPONENTS (10)
+
+static void transform_array_components(struct transform_array *transforms,
+                                       float **components[]) {
+  components[0] = &transforms->position_x;
+  components[1] = &transforms->position_y;
+  components[2] = &transforms->position_z;
+  components[3] = &transforms->rotation_x;
+  components[4] = &transforms->rotation_y;
+  components[5] = &transforms->rotation_z;
+  components[6] = &transforms->rotation_w;
+  components[7] = &transforms->scale_x;
+  components[8] = &transforms->scale_y;
+  components[9] = &transforms->scale_z;
+}
+
+static void transform_array_reserve(struct transform_array *transforms,
+                                    const unsigned int capacity) {
+  if (capacity <= transforms->capacity) {
+    return;
+  }
+
+  float **components[TRANSFORM_ARRAY_COMPONENTS];
+  transform_array_components(transforms, components);
+  for (int i = 0; i < TRANSFORM_ARRAY_COMPONENTS; i++) {
+    *components[i] = realloc(*components[i], capacity * sizeof(float));
+  }
+  transforms->capacity = capacity;
+}
+
+struct transform_array transform_array_alloc(const unsigned int capacity) {
+  struct transform_array transforms = {0};
+  transform_array_reserve(&transforms, capacity > 0 ? capacity : 1);
+  return transforms;
+}
+
+void transform_array_free(struct transform_array *transforms) {
+  float **components[TRANSFORM_ARRAY_COMPONENTS];
+  transform_array_components(transforms, components);
+  for (int i = 0; i < TRANSFORM_ARRAY_COMPONENTS; i++) {
+    free(*components[i]);
+    *components[i] = NULL;
+  }
+  transforms->count = transforms->capacity = 0;
+}
+
+void transform_array_set(struct transform_array *transforms,
+                         const unsigned int index,
+                         const struct transform transform) {
+  transforms->position_x[index] = transform.position.x;
+  transforms->position_y[index] = transform.position.y;
+  transforms->position_z[index] = transform.position.z;
+  transforms->rotation_x[index] = transform.rotation.x;
+  transforms->rotation_y[index] = transform.rotation.y;
+  transforms->rotation_z[index] = transform.rotation.z;
+  transforms->rotation_w[index] = transform.rotation.w;
+  transforms->scale_x[index] = transform.scale.x;
+  transforms->scale_y[index] = transform.scale.y;
+  transforms->scale_z[index] = transform.scale.z;
+}
+
+struct transform transform_array_get(const struct transform_array *transforms,
+                                     const unsigned int index) {
+  return (struct transform){
+      .position = (struct vec3){transforms->position_x[index],
+                                transforms->position_y[index],
+                                transforms->position_z[index]},
+      .rotation = (struct quat){transforms->rotation_x[index],
+                                transforms->rotation_y[index],
+                                transforms->rotation_z[index],
+                                transforms->rotation_w[index]},
+      .scale = (struct vec3){transforms->scale_x[index],
+                             transforms->scale_y[index],
+                             transforms->scale_z[index]},
+  };
+}
+
+unsigned int transform_array_add(struct transform_array *transforms,
+                                 const struct transform transform) {
+  if (transforms->count >= transforms->capacity) {
+    transform_array_reserve(transforms, transforms->capacity * 2 + 1);
+  }
+  const unsigned int index = transforms->count++;
+  transform_array_set(transforms, index, transform);
+  return index;
+}
+
+// writes the model matrix of every transform in 'transforms' into 'buffer'.
+// the buffer is orphaned and mapped so the matrices are generated straight
+// into driver memory without an intermediate copy.
+void engine_transform_array_upload(GLuint buffer,
+                                   const struct transform_array *transforms) {
+  const GLsizeiptr size = transforms->count * 16 * sizeof(GLfloat);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+  if (size == 0) {
+    return;
+  }
+
+  GLfloat *matrices = glMapBufferRange(
+      GL_ARRAY_BUFFER, 0, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT);
+  if (matrices == NULL) {
+    engine_error("failed to map transform buffer %u", buffer);
+    return;
+  }
+
+  mathf_transform_matrix_batch(matrices, transforms, 0, transforms->count);
+
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+}
@@ -1,22 +1,72 @@
 #include "engine.h"
+#include <ctype.h>
+#include <string.h>
 #include <time.h>
 
 static struct camera camera = {0};
 
-static vec3 light_position = (vec3){10, 10, 0};
+// the camera is simulated in world space, and camera.transform is set
+// between the last two steps before every draw.
+static struct transformd camera_transform = {0};
+static struct transformd camera_transform_previous = {0};
 
-static GLuint planet_shader = 0;
+// mouse movement not yet applied. the mouse is read once per frame, and the
+// next step turns the camera by all of it.
+static struct vec3 camera_look = {0};
+
+// radians of turn per unit of mouse movement.
+static const float camera_look_sensitivity = 0.1f / 60;
+static const float camera_roll_speed = 0.5f; // radians per second
+static const float camera_speed = 24;        // units per second
+static const float camera_fast_speed = 240;  // units per second
+
+static struct vec3d light_position = {10, 10, 0};
+
+// how the planet material projects its texture, cheapest last.
+enum planet_texturing {
+  PLANET_TEXTURING_TRIPLANAR,
+  PLANET_TEXTURING_DOMINANT_AXIS,
+  PLANET_TEXTURING_CUBEMAP,
+};
+
+// features of the planet shader, see planet_fragment.glsl. triplanar
+// blending is not worth three fetches once the planet is small on screen, so
+// far away draws fall back to the dominant axis.
+enum planet_feature {
+  PLANET_FEATURE_TRIPLANAR = 1 << 0,
+  PLANET_FEATURE_CUBEMAP = 1 << 1,
+};
+
+static const struct shader_feature planet_features[] = {
+    {.define = "PLANET_TEXTURING_TRIPLANAR", .max_depth = 5e4},
+    // the texture is a cube map, bound to a samplerCube.
+    {.define = "PLANET_TEXTURING_CUBEMAP", .is_required = true},
+};
+
+static const unsigned int planet_texturing_features[] = {
+    [PLANET_TEXTURING_TRIPLANAR] = PLANET_FEATURE_TRIPLANAR,
+    [PLANET_TEXTURING_DOMINANT_AXIS] = 0,
+    [PLANET_TEXTURING_CUBEMAP] = PLANET_FEATURE_CUBEMAP,
+};
+
+static enum planet_texturing planet_texturing = PLANET_TEXTURING_TRIPLANAR;
+
+// flat shaded stand-in, drawn while the real shaders are still compiling.
+static struct shader *fallback_shader = NULL;
+
+static struct shader_variants *planet_shader = NULL;
 static struct mesh planet_mesh = {0};
 static GLuint planet_texture = 0;
 
-static struct transform planet_transform = (struct transform){
-    .position = (struct vec3){0, 0, 2000},
+static struct transformd planet_transform = {
+    .position = (struct vec3d){0, 0, 2000},
     .scale = (struct vec3){1000, 1000, 1000},
     .rotation = (struct quat){0, 0, 0, 1},
 };
-static GLuint planet_atmosphere_shader = 0;
+static struct transformd planet_transform_previous = {0};
+static struct shader *planet_atmosphere_shader = NULL;
 static struct mesh planet_atmosphere_mesh = {0};
-static struct transform planet_atmosphere_transform = {0};
+static struct transformd planet_atmosphere_transform = {0};
 
 static struct mesh cube_mesh = {0};
 
@@ -25,9 +75,58 @@ static struct transform quad_transform = {
     .rotation = (struct quat){0, 0, 0, 1},
     .scale = (struct vec3){1, 1, 1},
 };
+static struct transform quad_transform_previous = {0};
+
+// scenes for --benchmark. each one adds many copies of a single mesh to the
+// scene and flies the camera along a scripted path, unless a recorded one is
+// given with --camera-path.
+enum benchmark_scene {
+  BENCHMARK_SCENE_NONE,
+  BENCHMARK_SCENE_PLANETS,
+  BENCHMARK_SCENE_ASTEROIDS,
+  BENCHMARK_SCENE_TERRAIN,
+  BENCHMARK_SCENE_VERTICES,
+  BENCHMARK_SCENE_COUNT,
+};
+
+static const char *benchmark_scene_names[] = {
+    [BENCHMARK_SCENE_PLANETS] = "planets",
+    [BENCHMARK_SCENE_ASTEROIDS] = "asteroids",
+    [BENCHMARK_SCENE_TERRAIN] = "terrain",
+    [BENCHMARK_SCENE_VERTICES] = "vertices",
+};
+
+// how finely the mesh of each scene is subdivided, see
+// engine_mesh_planet_generate.
+static const unsigned int benchmark_scene_subdivisions[] = {
+    [BENCHMARK_SCENE_PLANETS] = 6,
+    [BENCHMARK_SCENE_ASTEROIDS] = 1,
+    [BENCHMARK_SCENE_TERRAIN] = 8,
+    [BENCHMARK_SCENE_VERTICES] = 7,
+};
+
+static enum benchmark_scene benchmark_scene = BENCHMARK_SCENE_NONE;
+static struct mesh benchmark_mesh = {0};
+static struct transformd *benchmark_instances = NULL;
+static unsigned int benchmark_instances_count = 0;
+static list_camera_path_key benchmark_path = NULL;
+
+// camera poses of an interactive session, saved to --record-path on exit.
+static list_camera_path_key recorded_path = NULL;
+static double recorded_path_time = 0;
+static const double recorded_path_interval = 0.25; // seconds
+
+// the scene is simulated in steps of scene_step seconds. a frame runs as
+// many as have become due, but no more than scene_steps_max: a machine too
+// slow to keep up would otherwise spend ever longer frames catching up.
+static const double scene_step = 1.0 / 60.0;
+static const unsigned int scene_steps_max = 5;
 
 struct engine_time {
   double FPS, delta, last, current;
+  // time not yet simulated, and how far into the next step it reaches.
+  double accumulator, alpha;
+  unsigned long steps_dropped;
 } engine_time;
 
 struct engine_time engine_time_instance = {0};
@@ -44,10 +143,22 @@ void engine_time_update(void) {
   }
 
   engine_time_instance.current = spec.tv_sec + spec.tv_nsec * 1e-9;
-  engine_time_instance.delta =
-      engine_time_instance.current - engine_time_instance.last;
+
+  // the first update has no previous frame to measure.
+  if (engine_time_instance.last != 0) {
+    engine_time_instance.delta =
+        engine_time_instance.current - engine_time_instance.last;
+    engine_frame_stats_record(engine_time_instance.delta);
+  }
+  engine_time_instance.FPS =
+      engine_time_instance.delta > 0 ? 1 / engine_time_instance.delta : 0;
   engine_time_instance.last = engine_time_instance.current;
-  engine_time_instance.FPS = 1 / engine_time_instance.delta;
+
+  // benchmarks simulate every frame with the same step, however long it
+  // took, so runs are repeatable.
+  if (engine_benchmark_is_running()) {
+    engine_time_instance.delta = ENGINE_BENCHMARK_DELTA;
+  }
 
 #if 0
   engine_log("TIME: delta %lf | current %lf", engine_time_instance.delta,
@@ -55,6 +166,206 @@ void engine_time_update(void) {
 #endif
 }
 
+// the number of steps to simulate this frame. the time left over carries
+// into the next frame, and alpha is how far the frame is between the last
+// two steps.
+static unsigned int engine_time_steps(void) {
+  struct engine_time *time = &engine_time_instance;
+
+  // a benchmark frame is exactly one step and draws its end, so runs do not
+  // depend on rounding in the accumulator.
+  if (engine_benchmark_is_running()) {
+    time->alpha = 1;
+    return 1;
+  }
+
+  time->accumulator += time->delta;
+  unsigned int steps = 0;
+  while (time->accumulator >= scene_step) {
+    time->accumulator -= scene_step;
+    steps++;
+  }
+  if (steps > scene_steps_max) {
+    time->steps_dropped += steps - scene_steps_max;
+    steps = scene_steps_max;
+  }
+  time->alpha = time->accumulator / scene_step;
+  return steps;
+}
+
+static struct mesh scene_planet_mesh_alloc(const unsigned int subdivisions,
+                                           const float amplitude) {
+  list_vec3 vertices = NULL;
+  list_vec3 normals = NULL;
+  list_GLuint indices = NULL;
+  engine_mesh_planet_generate(subdivisions, vec3_one(1.0), vec3_zero(),
+                              amplitude, &vertices, &normals, &indices);
+
+  struct mesh mesh =
+      engine_mesh_pool_add(vertices, normals, list_vec3_count(vertices),
+                           indices, list_GLuint_count(indices));
+
+  list_GLuint_free(indices);
+  list_vec3_free(vertices);
+  list_vec3_free(normals);
+  return mesh;
+}
+
+// vertices and indices of a mesh made by engine_mesh_planet_generate, which
+// adds three vertices for every triangle it splits.
+static GLuint scene_planet_vertices_count(const unsigned int subdivisions) {
+  return 12 + 20 * ((1u << 2 * subdivisions) - 1);
+}
+
+static GLuint scene_planet_indices_count(const unsigned int subdivisions) {
+  return 60u << 2 * subdivisions;
+}
+
+// xorshift, so the scenes are laid out the same on every run and platform.
+static float benchmark_random(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return (*state >> 8) * (1.0f / (1u << 24));
+}
+
+static struct quat benchmark_random_rotation(uint32_t *state) {
+  const float two_pi = 2 * 3.14159265f;
+  return quat_from_euler((struct vec3){benchmark_random(state) * two_pi,
+                                       benchmark_random(state) * two_pi,
+                                       benchmark_random(state) * two_pi});
+}
+
+// a scripted lap around the y axis at 'radius' and 'height', 'duration'
+// seconds long. the camera either faces the axis or flies along the circle.
+static list_camera_path_key benchmark_path_orbit(const double radius,
+                                                 const double height,
+                                                 const double duration,
+                                                 const bool is_facing_axis) {
+  enum { keys_count = 17 };
+  list_camera_path_key keys = list_camera_path_key_alloc();
+  for (unsigned int i = 0; i < keys_count; i++) {
+    const double angle = 2 * 3.14159265358979 * i / (keys_count - 1);
+    const struct vec3d position = {radius * cos(angle), height,
+                                   radius * sin(angle)};
+    const struct vec3 forward =
+        is_facing_axis
+            ? (struct vec3){-position.x, -position.y, -position.z}
+            : (struct vec3){-sin(angle), 0, cos(angle)};
+    list_camera_path_key_add(
+        &keys, (struct camera_path_key){
+                   .time = duration * i / (keys_count - 1),
+                   .position = position,
+                   .rotation = quat_look_rotation(forward, vec3_up(1)),
+               });
+  }
+  return keys;
+}
+
+static list_camera_path_key benchmark_path_scripted(void) {
+  switch (benchmark_scene) {
+  case BENCHMARK_SCENE_PLANETS:
+    return benchmark_path_orbit(3e4, 8e3, 10, true);
+  case BENCHMARK_SCENE_ASTEROIDS:
+    return benchmark_path_orbit(4.5e3, 0, 10, false);
+  case BENCHMARK_SCENE_TERRAIN:
+    return benchmark_path_orbit(1.25e3, 0, 10, false);
+  case BENCHMARK_SCENE_VERTICES:
+    return benchmark_path_orbit(1.5e5, 2e4, 10, true);
+  default:
+    return NULL;
+  }
+}
+
+// fills the instances of the benchmark scene. everything but the terrain
+// shares the meshes of the regular scene.
+static void benchmark_scene_load(void) {
+  uint32_t random = 0x2545f491;
+
+  switch (benchmark_scene) {
+  case BENCHMARK_SCENE_PLANETS: {
+    // an 8x8 grid of full resolution planets.
+    enum { side = 8 };
+    const double spacing = 4e3;
+    benchmark_mesh = planet_mesh;
+    benchmark_instances_count = side * side;
+    benchmark_instances =
+        malloc(benchmark_instances_count * sizeof(*benchmark_instances));
+    for (unsigned int i = 0; i < benchmark_instances_count; i++) {
+      benchmark_instances[i] = (struct transformd){
+          .position = {(i % side - (side - 1) * 0.5) * spacing, 0,
+                       (i / side - (side - 1) * 0.5) * spacing},
+          .rotation = benchmark_random_rotation(&random),
+          .scale = vec3_one(1000),
+      };
+    }
+    break;
+  }
+  case BENCHMARK_SCENE_ASTEROIDS: {
+    // a flat ring of small rocks, which only instancing keeps cheap.
+    benchmark_mesh = scene_planet_mesh_alloc(
+        benchmark_scene_subdivisions[benchmark_scene], 0.4);
+    benchmark_instances_count = 1 << 14;
+    benchmark_instances =
+        malloc(benchmark_instances_count * sizeof(*benchmark_instances));
+    for (unsigned int i = 0; i < benchmark_instances_count; i++) {
+      const double angle = benchmark_random(&random) * 2 * 3.14159265358979;
+      const double distance = 3e3 + benchmark_random(&random) * 3e3;
+      benchmark_instances[i] = (struct transformd){
+          .position = {distance * cos(angle),
+                       (benchmark_random(&random) - 0.5) * 600,
+                       distance * sin(angle)},
+          .rotation = benchmark_random_rotation(&random),
+          .scale = vec3_one(5 + benchmark_random(&random) * 35),
+      };
+    }
+    break;
+  }
+  case BENCHMARK_SCENE_TERRAIN: {
+    // a single planet subdivided far beyond the regular one, seen from just
+    // above its surface.
+    benchmark_mesh = scene_planet_mesh_alloc(
+        benchmark_scene_subdivisions[benchmark_scene], 0.1);
+    benchmark_instances_count = 1;
+    benchmark_instances = malloc(sizeof(*benchmark_instances));
+    benchmark_instances[0] = (struct transformd){
+        .rotation = (struct quat){0, 0, 0, 1},
+        .scale = vec3_one(1000),
+    };
+    break;
+  }
+  case BENCHMARK_SCENE_VERTICES: {
+    // a 4x4 grid of finely subdivided planets seen from far away. each
+    // covers few pixels, so the frame is bound by the vertex stage.
+    enum { side = 4 };
+    const double spacing = 4e3;
+    benchmark_mesh = scene_planet_mesh_alloc(
+        benchmark_scene_subdivisions[benchmark_scene], 0.1);
+    benchmark_instances_count = side * side;
+    benchmark_instances =
+        malloc(benchmark_instances_count * sizeof(*benchmark_instances));
+    for (unsigned int i = 0; i < benchmark_instances_count; i++) {
+      benchmark_instances[i] = (struct transformd){
+          .position = {(i % side - (side - 1) * 0.5) * spacing, 0,
+                       (i / side - (side - 1) * 0.5) * spacing},
+          .rotation = benchmark_random_rotation(&random),
+          .scale = vec3_one(1000),
+      };
+    }
+    break;
+  }
+  default:
+    return;
+  }
+
+  // every frame of the run should draw the real shaders, at any distance.
+  engine_shader_wait(engine_shader_variant_request(
+      planet_shader, planet_texturing_features[planet_texturing]));
+  engine_shader_wait(engine_shader_variant_request(
+      planet_shader,
+      planet_texturing_features[planet_texturing] & ~PLANET_FEATURE_TRIPLANAR));
+}
+
 void engine_scene_load(void) {
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_CULL_FACE);
@@ -62,76 +373,137 @@ void engine_scene_load(void) {
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glClearColor(0.3, 0.4, 0.5, 1.0);
 
-  planet_shader = engine_shader_create("res/shaders/planet_vertex.glsl",
-                                       "res/shaders/planet_fragment.glsl");
-
-  planet_texture = engine_texture_alloc("res/textures/moon_1.jpeg");
+  // start every compile up front, so the driver works on them while the
+  // textures and meshes are loaded. nothing here waits for the results.
+  planet_shader = engine_shader_variants_alloc(
+      "res/shaders/planet_vertex.glsl", "res/shaders/planet_fragment.glsl",
+      planet_features, sizeof(planet_features) / sizeof(*planet_features));
+  engine_shader_variant_request(planet_shader,
+                                planet_texturing_features[planet_texturing]);
+  planet_atmosphere_shader =
+      engine_shader_load("res/shaders/planet_atmosphere_vertex.glsl",
+                         "res/shaders/planet_atmosphere_fragment.glsl", NULL);
+
+  // the atmosphere gets no fallback, since an opaque stand-in would hide the
+  // planet. it is simply not drawn until it is ready.
+  fallback_shader =
+      engine_shader_create("res/shaders/hello_triangle_vertex.glsl",
+                           "res/shaders/hello_triangle_fragment.glsl");
+  planet_shader->fallback = fallback_shader;
+
+  if (planet_texturing == PLANET_TEXTURING_CUBEMAP) {
+    planet_texture = engine_texture_cube_alloc("res/textures/moon_1.jpeg");
+  } else {
+    planet_texture = engine_texture_alloc("res/textures/moon_1.jpeg");
+  }
   camera = camera_alloc();
+  camera.far = 1e9;
+  camera_transform = transformd_from_transform(camera.transform);
+  camera_transform_previous = camera_transform;
+  planet_transform_previous = planet_transform;
+  quad_transform_previous = quad_transform;
+  // the headless framebuffer has a float depth buffer, a window's usually
+  // does not.
+  if (camera_depth_mode_is_supported(CAMERA_DEPTH_REVERSED_Z)) {
+    engine_log("using reversed-Z depth");
+    camera_depth_mode_set(&camera, CAMERA_DEPTH_REVERSED_Z);
+  } else {
+    engine_log("no float depth buffer, using logarithmic depth");
+    camera_depth_mode_set(&camera, CAMERA_DEPTH_LOGARITHMIC);
+  }
+  engine_frame_constants_alloc();
+  engine_gpu_profiler_alloc();
+
+  // static meshes share the pool so they can be drawn with indirect draws.
+  GLuint pool_vertices = 1 << 18, pool_indices = 1 << 20;
+  if (benchmark_scene != BENCHMARK_SCENE_NONE) {
+    const unsigned int subdivisions =
+        benchmark_scene_subdivisions[benchmark_scene];
+    pool_vertices += scene_planet_vertices_count(subdivisions);
+    pool_indices += scene_planet_indices_count(subdivisions);
+  }
+  engine_mesh_pool_alloc(pool_vertices, pool_indices);
 
   float amplitude = 0.1;
-  planet_mesh = engine_mesh_planet_alloc(6, vec3_one(1.0), vec3_zero(), amplitude);
+  planet_mesh = scene_planet_mesh_alloc(6, amplitude);
 
-  planet_atmosphere_shader = engine_shader_create("res/shaders/planet_atmosphere_vertex.glsl",
-                                       "res/shaders/planet_atmosphere_fragment.glsl");
-  planet_atmosphere_mesh = engine_mesh_planet_alloc(6, vec3_one(1.0), vec3_zero(), 0);
+  planet_atmosphere_mesh = scene_planet_mesh_alloc(6, 0);
   //planet_atmosphere_mesh.use_clockwise_winding = true;
   planet_atmosphere_transform = planet_transform;
   planet_atmosphere_transform.scale = vec3_scaled(planet_transform.scale, amplitude * 12);
 
-  cube_mesh = engine_mesh_cube_alloc();
-}
-
-void engine_draw(struct mesh mesh, struct transform transform, GLuint shader,
-                 GLuint texture) {
-  if (mesh.use_clockwise_winding) {
-    glFrontFace(GL_CW);
-  } else {
-    glFrontFace(GL_CCW);
-  }
-  glUseProgram(shader);
-  {
-    GLint camera_matrix_location =
-        glGetUniformLocation(shader, "u_camera_matrix");
-    glUniformMatrix4fv(camera_matrix_location, 1, GL_FALSE, camera.matrix);
-  }
+  cube_mesh = engine_mesh_pool_add(engine_mesh_cube_vertices,
+                                   engine_mesh_cube_normals, 36, NULL, 0);
 
-  {
-    GLfloat transform_matrix[16];
-    mathf_transform_matrix(transform_matrix, &transform);
+  benchmark_scene_load();
+}
 
-    GLint model_matrix_location =
-        glGetUniformLocation(shader, "u_transform_matrix");
-    glUniformMatrix4fv(model_matrix_location, 1, GL_FALSE, transform_matrix);
-  }
+// queues 'mesh' using a double precision transform. the camera origin is
+// subtracted in double before the model matrix is rounded to float.
+void engine_drawd(const struct mesh *mesh, struct transformd transform,
+                  struct shader *shader, GLuint texture,
+                  enum engine_render_pass pass) {
+  GLfloat transform_matrix[16];
+  mathf_transformd_matrix(transform_matrix, &transform, camera.origin);
+  engine_render_queue_submit(mesh, transform_matrix, shader, texture, pass);
+}
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glUniform1i(glGetUniformLocation(shader, "u_diffuse_map"), 0);
+// queues 'mesh' with the cheapest ready variant of 'variants' that has
+// 'features' at the mesh's distance from the camera.
+void engine_drawd_variant(const struct mesh *mesh, struct transformd transform,
+                          struct shader_variants *variants,
+                          const unsigned int features, GLuint texture,
+                          enum engine_render_pass pass) {
+  GLfloat transform_matrix[16];
+  mathf_transformd_matrix(transform_matrix, &transform, camera.origin);
+  engine_render_queue_submit_variant(mesh, transform_matrix, variants,
+                                     features, texture, pass);
+}
 
-  glUniform3f(glGetUniformLocation(shader, "u_light_position"),
-              light_position.x, light_position.y, light_position.z);
+void engine_draw(const struct mesh *mesh, struct transform transform,
+                 struct shader *shader, GLuint texture,
+                 enum engine_render_pass pass) {
+  engine_drawd(mesh, transformd_from_transform(transform), shader, texture,
+               pass);
+}
 
-  glUniform3f(glGetUniformLocation(shader, "u_camera_position"),
-              camera.transform.position.x, camera.transform.position.y,
-              camera.transform.position.z);
+// moves the camera along the benchmark path, at the run's simulated time.
+static void benchmark_camera_update(void) {
+  camera_path_sample(benchmark_path, engine_benchmark_time(),
+                     &camera_transform.position, &camera_transform.rotation);
+}
 
-  glBindVertexArray(mesh.VAO);
-  if (mesh.use_indexed_draw) {
-    glDrawElements(GL_TRIANGLES, mesh.indices_count, GL_UNSIGNED_INT, 0);
-  } else {
-    glDrawArrays(GL_TRIANGLES, 0, mesh.vertices_count);
+// adds the camera pose to the recorded path every recorded_path_interval.
+static void recorded_path_update(void) {
+  const list_size count = list_camera_path_key_count(recorded_path);
+  if (count == 0 || recorded_path_time >= recorded_path[count - 1].time +
+                                              recorded_path_interval) {
+    list_camera_path_key_add(&recorded_path,
+                             (struct camera_path_key){
+                                 .time = recorded_path_time,
+                                 .position = camera_transform.position,
+                                 .rotation = camera_transform.rotation,
+                             });
   }
+  recorded_path_time += scene_step;
 }
 
-void engine_scene_update(void) {
+// collects the mouse movement of the frame. call once per frame.
+static void scene_input_update(void) {
+  float x = 0, y = 0;
+  engine_mouse_delta_get(&x, &y);
+  camera_look.x += y * camera_look_sensitivity;
+  camera_look.y += x * camera_look_sensitivity;
+}
 
-  vec3 look_angles = vec3_zero();
-  look_angles.z = 5.0 * (engine_key_get(ENGINE_KEY_Q) - engine_key_get(ENGINE_KEY_E));
-  engine_mouse_delta_get(&look_angles.y, &look_angles.x);
-  vec3_scale(&look_angles, engine_time_get()->delta * 0.1);
+static void scene_camera_input(void) {
+  vec3 look_angles = camera_look;
+  look_angles.z = camera_roll_speed * scene_step *
+                  (engine_key_get(ENGINE_KEY_Q) - engine_key_get(ENGINE_KEY_E));
+  camera_look = vec3_zero();
 
-  camera.transform.rotation =
-      quat_rotate_euler(camera.transform.rotation, look_angles);
+  camera_transform.rotation =
+      quat_rotate_euler(camera_transform.rotation, look_angles);
 
   struct vec3 movedir = (struct vec3){
       engine_key_get(ENGINE_KEY_D) - engine_key_get(ENGINE_KEY_A),
@@ -140,47 +512,262 @@ void engine_scene_update(void) {
   };
 
   vec3_normalize(&movedir);
-  float speed = engine_key_get(ENGINE_KEY_CTRL) ? 4.0 : 0.4;
-  vec3_scale(&movedir, speed);
+  float speed =
+      engine_key_get(ENGINE_KEY_CTRL) ? camera_fast_speed : camera_speed;
+  vec3_scale(&movedir, speed * scene_step);
 
   // translate to local directions
-  movedir = vec3_rotate(movedir, camera.transform.rotation);
+  movedir = vec3_rotate(movedir, camera_transform.rotation);
 
   // engine_log(MATHF_vec3_FORMAT_STRING(movedir));
-  vec3_add(&camera.transform.position, movedir);
+  vec3d_add(&camera_transform.position, vec3d_from_vec3(movedir));
+}
+
+// advances the scene by one step of scene_step seconds.
+void engine_scene_update(void) {
+  camera_transform_previous = camera_transform;
+  planet_transform_previous = planet_transform;
+  quad_transform_previous = quad_transform;
+
+  if (engine_benchmark_is_running()) {
+    benchmark_camera_update();
+  } else {
+    scene_camera_input();
+    if (recorded_path != NULL) {
+      recorded_path_update();
+    }
+  }
 
-  camera_update(&camera);
   planet_transform.rotation = quat_rotate_euler(
-      planet_transform.rotation, vec3_one(engine_time_get()->delta * 0.000729));
+      planet_transform.rotation, vec3_one(scene_step * 0.000729));
 
   quad_transform.rotation =
-      quat_rotate_euler(quad_transform.rotation, vec3_up(0.005));
+      quat_rotate_euler(quad_transform.rotation, vec3_up(scene_step * 0.3));
+}
+
+// places the camera between the last two steps for drawing.
+static void scene_camera_interpolate(const float alpha) {
+  const struct transformd transform =
+      transformd_lerp(camera_transform_previous, camera_transform, alpha);
+  camera.transform.position =
+      vec3d_relative(transform.position, camera.origin);
+  camera.transform.rotation = transform.rotation;
+  camera_recenter(&camera);
+  camera_update(&camera);
 }
 
 void engine_scene_draw(void) {
+  const float alpha = engine_time_get()->alpha;
+  scene_camera_interpolate(alpha);
+
+  engine_stream_frame_begin();
+  engine_gpu_profiler_frame_begin();
+  engine_gpu_profiler_begin("frame");
+
+  engine_gpu_profiler_begin("clear");
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  engine_gpu_profiler_end();
+
+  { // everything uploaded to the GPU is relative to the camera origin.
+    struct engine_frame_constants constants = {0};
+    for (int i = 0; i < 16; i++) {
+      constants.camera_matrix[i] = camera.matrix[i];
+    }
+
+    constants.camera_position[0] = camera.transform.position.x;
+    constants.camera_position[1] = camera.transform.position.y;
+    constants.camera_position[2] = camera.transform.position.z;
+
+    const struct vec3 light = vec3d_relative(light_position, camera.origin);
+    constants.light_position[0] = light.x;
+    constants.light_position[1] = light.y;
+    constants.light_position[2] = light.z;
+
+    constants.log_depth = camera.log_depth_coefficient;
+    engine_frame_constants_update(&constants);
+  }
 
   // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-  // engine_draw(planet_mesh, planet_transform, planet_shader, planet_texture);
-  // engine_draw(planet_atmosphere_mesh, planet_atmosphere_transform, planet_atmosphere_shader, 0);
-  engine_draw(cube_mesh, quad_transform, planet_shader, planet_texture);
+  engine_render_queue_begin();
+  // engine_drawd_variant(&planet_mesh, transformd_lerp(planet_transform_previous, planet_transform, alpha), planet_shader, planet_texturing_features[planet_texturing], planet_texture, ENGINE_RENDER_PASS_OPAQUE);
+  // engine_drawd(&planet_atmosphere_mesh, planet_atmosphere_transform, planet_atmosphere_shader, 0, ENGINE_RENDER_PASS_TRANSPARENT);
+  engine_render_queue_scope("cube");
+  engine_drawd_variant(&cube_mesh,
+                       transformd_lerp(
+                           transformd_from_transform(quad_transform_previous),
+                           transformd_from_transform(quad_transform), alpha),
+                       planet_shader,
+                       planet_texturing_features[planet_texturing],
+                       planet_texture, ENGINE_RENDER_PASS_OPAQUE);
+  if (benchmark_instances_count > 0) {
+    engine_render_queue_scope(benchmark_scene_names[benchmark_scene]);
+    for (unsigned int i = 0; i < benchmark_instances_count; i++) {
+      engine_drawd_variant(&benchmark_mesh, benchmark_instances[i],
+                           planet_shader,
+                           planet_texturing_features[planet_texturing],
+                           planet_texture, ENGINE_RENDER_PASS_OPAQUE);
+    }
+  }
+  engine_render_queue_flush();
+
+  engine_gpu_profiler_end();
+  engine_gpu_profiler_frame_end();
+  engine_stream_frame_end();
 }
 
-int main() {
-  engine_start();
+// frames written to trace_path, as a Chrome trace, when F12 is pressed. a
+// press during a capture is ignored.
+static const char *trace_path = "trace.json";
+static const unsigned long trace_frames_count = 10;
+
+// every frame time of the run is written here on exit.
+static const char *frame_times_path = "frame_times.csv";
+
+// frames drawn by --headless when no count is given. a benchmark draws its
+// whole camera path instead.
+static const unsigned long headless_frames_count = 600;
+
+// the frames of a --benchmark run are written here on exit.
+static const char *benchmark_output_path = "benchmark.json";
+
+// usage: game [--headless [frames]] [--benchmark scene]
+//             [--camera-path file] [--record-path file] [--gpu-profile]
+// --headless draws a fixed number of frames offscreen, without a window,
+// and exits with the timing reports.
+// --benchmark loads one of benchmark_scene_names and flies the camera along
+// its path with a fixed timestep, writing per frame timings and draw counts
+// to benchmark_output_path. --camera-path replays a recorded path instead of
+// the scripted one, and --record-path records one from an interactive run.
+// --gpu-profile times every render queue scope on its own, at the cost of
+// batching, instead of only the passes.
+int main(int argc, char *argv[]) {
+  bool is_headless = false;
+  unsigned long frames_count = 0;
+  const char *camera_path_file = NULL;
+  const char *record_path_file = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0) {
+      is_headless = true;
+      if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+        frames_count = strtoul(argv[++i], NULL, 10);
+      }
+    } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+      i++;
+      for (int scene = BENCHMARK_SCENE_NONE + 1;
+           scene < BENCHMARK_SCENE_COUNT; scene++) {
+        if (strcmp(argv[i], benchmark_scene_names[scene]) == 0) {
+          benchmark_scene = scene;
+        }
+      }
+      if (benchmark_scene == BENCHMARK_SCENE_NONE) {
+        engine_error("unknown benchmark scene '%s'", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc) {
+      camera_path_file = argv[++i];
+    } else if (strcmp(argv[i], "--record-path") == 0 && i + 1 < argc) {
+      record_path_file = argv[++i];
+    } else if (strcmp(argv[i], "--gpu-profile") == 0) {
+      engine_render_queue_scopes_enable(true);
+    } else {
+      engine_error("unknown argument '%s'", argv[i]);
+      return 1;
+    }
+  }
+
+  if (benchmark_scene != BENCHMARK_SCENE_NONE) {
+    benchmark_path = camera_path_file != NULL
+                         ? camera_path_load(camera_path_file)
+                         : benchmark_path_scripted();
+    if (benchmark_path == NULL) {
+      return 1;
+    }
+    if (frames_count == 0) {
+      const double duration = camera_path_duration(benchmark_path);
+      frames_count = lround(duration / ENGINE_BENCHMARK_DELTA) + 1;
+    }
+  } else if (record_path_file != NULL) {
+    recorded_path = list_camera_path_key_alloc();
+  }
+  if (is_headless) {
+    engine_headless_set(frames_count > 0 ? frames_count
+                                         : headless_frames_count);
+  }
+
+  engine_profiler_thread_name("main");
+  if (!engine_start()) {
+    return 1;
+  }
+  engine_shader_watch_start();
   engine_scene_load();
+  if (benchmark_scene != BENCHMARK_SCENE_NONE) {
+    engine_benchmark_begin(benchmark_scene_names[benchmark_scene], "frame");
+  }
 
   while (engine_is_running()) {
+    engine_profiler_frame_begin();
+    engine_profiler_begin("frame");
+    engine_benchmark_frame_begin();
+
     engine_time_update();
-    engine_scene_update();
+
+    engine_profiler_begin("shader reload");
+    engine_shader_watch_update();
+    engine_profiler_end();
+
+    engine_profiler_begin("scene update");
+    scene_input_update();
+    for (unsigned int steps = engine_time_steps(); steps > 0; steps--) {
+      engine_scene_update();
+    }
+    engine_profiler_end();
+
+    engine_profiler_begin("scene draw");
     engine_scene_draw();
+    engine_profiler_end();
+
+    engine_benchmark_frame_end();
+
+    engine_profiler_begin("engine update");
     engine_update();
+    engine_profiler_end();
+
+    engine_profiler_end();
+
+    if (engine_key_get(ENGINE_KEY_F12)) {
+      engine_profiler_capture(engine_profiler_frame() + 1,
+                              trace_frames_count, trace_path);
+    }
 
     if (engine_key_get(ENGINE_KEY_ESCAPE)) {
       break;
     }
+
+    // the last frame sits on the end of the path.
+    if (engine_benchmark_is_running() &&
+        engine_benchmark_time() >
+            camera_path_duration(benchmark_path) + ENGINE_BENCHMARK_DELTA / 2) {
+      break;
+    }
   }
 
+  if (engine_benchmark_is_running()) {
+    engine_benchmark_end();
+    engine_benchmark_write(benchmark_output_path);
+  }
+  if (recorded_path != NULL) {
+    camera_path_save(recorded_path, record_path_file);
+  }
+  if (engine_time_instance.steps_dropped > 0) {
+    engine_warn("the simulation fell behind by %lu steps",
+                engine_time_instance.steps_dropped);
+  }
+  engine_frame_stats_report();
+  engine_frame_stats_write_csv(frame_times_path);
+  engine_gpu_profiler_report();
+  engine_gpu_profiler_free();
+  engine_shader_watch_stop();
   engine_stop();
 }